@@ -0,0 +1,472 @@
+// Microbenchmarks of the math, collision and level primitives. Every case is warmed up, then timed over a number of
+// samples of many calls each; the report has the median, p99 and median absolute deviation in ns per call.
+// The collision cases run on every game level with all chunks loaded, so run it from the repo root.
+// The move cases time one 60 Hz frame of movement at 6000 px/s, up to 100 pixel steps per axis, with the
+// std::function callback moveX and moveY used to take next to the FunctionRef they take now.
+// The moving solid cases time one frame of GameState::updateMovingSolids on the first level with extra moving
+// blocks and enemies spread over it.
+//
+// Usage: primitives_bench [--samples=N] [--json=<file>] [--filter=<name substring>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+#include "definitions.h"
+
+GameState* state = nullptr;
+
+// Defined by game.cpp, nothing here reaches them
+void changeCurrentState(State) {}
+void emitBlockDebris(const Rect2f&, Vector2f) {}
+void emitBubblePop(Vector2f, real32) {}
+void clearParticles() {}
+
+// Speed of the move cases in px/s and the frame they move for
+constexpr real32 move_speed = 6000;
+constexpr real32 move_time_delta = 1.0f / 60;
+
+// Actor::moveX and moveY before they took a CollisionCallback: the std::function was passed on by value, so it was
+// copied on every pixel step
+static bool handleCollisionByValue(Vector2f position, std::function<void()> on_collide, int& move, int sign, Actor* actor, real32& coord)
+{
+	return handleCollision(position, on_collide, move, sign, actor, coord);
+}
+
+static void moveXByValue(Actor& actor, real32 amount, std::function<void()> on_collide)
+{
+	actor.xRemainder += amount;
+	int move = round(actor.xRemainder);
+	if (move != 0)
+	{
+		actor.xRemainder -= move;
+		int sign = SIGN(move);
+		while (move != 0)
+		{
+			if (handleCollisionByValue(actor.position + Vector2f(sign, 0), on_collide, move, sign, &actor, actor.position.x))
+			{
+				break;
+			}
+		}
+	}
+}
+
+static void moveYByValue(Actor& actor, real32 amount, std::function<void()> on_collide)
+{
+	actor.yRemainder += amount;
+	int move = round(actor.yRemainder);
+	if (move != 0)
+	{
+		actor.yRemainder -= move;
+		int sign = SIGN(move);
+		while (move != 0)
+		{
+			if (handleCollisionByValue(actor.position + Vector2f(0, sign), on_collide, move, sign, &actor, actor.position.y))
+			{
+				break;
+			}
+		}
+	}
+}
+
+// Block and enemy counts of the moving solid cases
+constexpr uint32 moving_solid_counts[] = {16, 256};
+constexpr uint32 moving_actor_counts[] = {16, 256};
+
+// Enough for the p99 to leave out the two slowest samples
+constexpr int32 default_samples = 200;
+// Calls that are not part of the statistics
+constexpr int32 warmup_samples = 3;
+// Inputs the cases cycle through, small enough to stay in cache
+constexpr uint32 input_count = 1024;
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchResult
+{
+	std::string name;
+	uint32 callsPerSample = 0;
+	real64 medianNs = 0;
+	real64 p99Ns = 0;
+	real64 madNs = 0;
+	real64 minNs = 0;
+};
+
+// Results are summed into this so the calls can not be optimized away
+static volatile real64 bench_sink = 0;
+
+static real64 getMedian(std::vector<real64> values)
+{
+	std::sort(values.begin(), values.end());
+	const size_t middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+class BenchRunner
+{
+public:
+	BenchRunner(int32 samples, const char* filter) : samples(samples), filter(filter)
+	{
+	}
+
+	/// call(i) does the work of one call for input i and returns something that depends on it. A template so
+	/// the call can be inlined into the timed loop.
+	template <typename Call>
+	void run(const std::string& name, uint32 calls, const Call& call)
+	{
+		if (filter && name.find(filter) == std::string::npos)
+		{
+			return;
+		}
+
+		std::vector<real64> nsPerCall;
+		nsPerCall.reserve(samples);
+		real64 sink = 0;
+		for (int32 s = 0; s < warmup_samples + samples; ++s)
+		{
+			const auto start = BenchClock::now();
+			for (uint32 i = 0; i < calls; ++i)
+			{
+				sink += call(i);
+			}
+			const real64 ns = (real64)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+			if (s >= warmup_samples)
+			{
+				nsPerCall.push_back(ns / calls);
+			}
+		}
+		bench_sink = bench_sink + sink;
+
+		BenchResult result;
+		result.name = name;
+		result.callsPerSample = calls;
+		result.medianNs = getMedian(nsPerCall);
+		std::vector<real64> deviations(nsPerCall.size());
+		for (size_t i = 0; i < nsPerCall.size(); ++i)
+		{
+			deviations[i] = fabs(nsPerCall[i] - result.medianNs);
+		}
+		result.madNs = getMedian(deviations);
+		std::sort(nsPerCall.begin(), nsPerCall.end());
+		result.minNs = nsPerCall.front();
+		// Nearest rank, so it is only below the slowest sample from 100 samples on
+		result.p99Ns = nsPerCall[(size_t)ceil(0.99 * nsPerCall.size()) - 1];
+		results.push_back(result);
+
+		printf("%-36s %12.1f %12.1f %10.1f %12.1f\n", name.c_str(), result.medianNs, result.p99Ns, result.madNs, result.minNs);
+		fflush(stdout);
+	}
+
+	bool writeJson(const char* filename) const
+	{
+		FILE* file = fopen(filename, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Could not write %s\n", filename);
+			return false;
+		}
+		fprintf(file, "{\n  \"benchmark\": \"primitives\",\n  \"samples\": %d,\n  \"warmup_samples\": %d,\n  \"results\": [\n", samples, warmup_samples);
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchResult& result = results[i];
+			fprintf(file, "    {\"name\": \"%s\", \"calls_per_sample\": %u, \"median_ns\": %.3f, \"p99_ns\": %.3f, \"mad_ns\": %.3f, \"min_ns\": %.3f}%s\n",
+			        result.name.c_str(), result.callsPerSample, result.medianNs, result.p99Ns, result.madNs, result.minNs,
+			        i + 1 < results.size() ? "," : "");
+		}
+		fprintf(file, "  ]\n}\n");
+		fclose(file);
+		return true;
+	}
+
+private:
+	int32 samples;
+	const char* filter;
+	std::vector<BenchResult> results;
+};
+
+static void runMathCases(BenchRunner& runner, std::mt19937& rng)
+{
+	std::uniform_real_distribution<real32> coord(0, 4000);
+	std::uniform_real_distribution<real32> size(10, 500);
+	std::vector<Vector2f> points(input_count);
+	std::vector<Rect2f> rects(input_count);
+	for (uint32 i = 0; i < input_count; ++i)
+	{
+		points[i] = {coord(rng), coord(rng)};
+		rects[i] = {coord(rng), coord(rng), size(rng), size(rng)};
+	}
+	const auto next = [](uint32 i) { return (i + 1) % input_count; };
+	const auto at = [](uint32 i) { return i % input_count; };
+
+	runner.run("vector/add_scale_sub", 1 << 20, [&](uint32 i) {
+		const Vector2f v = (points[at(i)] + points[next(i)]) * 0.5f - points[at(i + 7)];
+		return (real64)(v.x + v.y);
+	});
+	runner.run("vector/normalize", 1 << 20, [&](uint32 i) {
+		const Vector2f v = (points[at(i)] - points[next(i)]).getNormalized();
+		return (real64)(v.x + v.y);
+	});
+	runner.run("vector/magnitude", 1 << 20, [&](uint32 i) {
+		return (real64)(points[at(i)] - points[next(i)]).getMagnitude();
+	});
+	runner.run("rotate_point", 1 << 20, [&](uint32 i) {
+		const Vector2f v = rotatePoint(points[at(i)], points[next(i)], (real32)(i % 360));
+		return (real64)(v.x + v.y);
+	});
+	runner.run("rect/collides", 1 << 20, [&](uint32 i) {
+		return (real64)rects[at(i)].collides(rects[next(i)]);
+	});
+	runner.run("rect/collision_depth", 1 << 20, [&](uint32 i) {
+		const Vector2f depth = rects[at(i)].collisionDepth(rects[next(i)]);
+		return (real64)(depth.x + depth.y);
+	});
+	runner.run("aabb_line", 1 << 20, [&](uint32 i) {
+		return (real64)checkAABBLineCollision(points[at(i)], points[next(i)], rects[at(i + 3)]);
+	});
+}
+
+static void runLevelCases(BenchRunner& runner, std::mt19937& rng, int32 levelIndex)
+{
+	Level* level = &state->levels[levelIndex];
+	state->currentLevel = level;
+	for (uint32 chunk = 0; chunk < level->chunks.size(); ++chunk)
+	{
+		level->loadChunk(chunk);
+	}
+	const std::string prefix = std::string(level_filenames[levelIndex], strlen(level_filenames[levelIndex]) - 4) + "/";
+
+	std::uniform_real_distribution<real32> xDist(0, (real32)level->width);
+	std::uniform_real_distribution<real32> yDist(0, (real32)level->height);
+	std::vector<Vector2f> points(input_count);
+	for (Vector2f& point : points)
+	{
+		point = {xDist(rng), yDist(rng)};
+	}
+	const auto at = [](uint32 i) { return i % input_count; };
+
+	Player& player = state->player;
+	player.hitRect = player.hitRects[0];
+	const Rect2f hitRect = player.hitRect;
+	runner.run(prefix + "actor_collide_at", 1 << 18, [&](uint32 i) {
+		return (real64)(player.collideAt(level, points[at(i)]) != nullptr);
+	});
+	runner.run(prefix + "check_collision", 1 << 18, [&](uint32 i) {
+		const Vector2f depth = checkCollision(level, {points[at(i)].x, points[at(i)].y, hitRect.w, hitRect.h});
+		return (real64)(depth.x + depth.y);
+	});
+
+	// Puffing up next to walls, from random places where the normal hitbox is free
+	std::vector<Vector2f> freePoints;
+	for (int32 tries = 0; freePoints.size() < input_count && tries < 100 * (int32)input_count; ++tries)
+	{
+		const Vector2f point = {xDist(rng), yDist(rng)};
+		if (!player.collideAt(level, point))
+		{
+			freePoints.push_back(point);
+		}
+	}
+	if (!freePoints.empty())
+	{
+		runner.run(prefix + "try_hit_rect_change", 1 << 16, [&](uint32 i) {
+			player.position = freePoints[i % freePoints.size()];
+			player.hitRect = hitRect;
+			const bool changed = player.tryHitRectChange(-player.puffOffset, player.hitRects[1]);
+			return (real64)changed + player.position.x;
+		});
+
+		// Same start, direction and callback for both, so only the callback passing differs
+		std::uniform_real_distribution<real32> angleDist(0, 2 * (real32)M_PI);
+		std::vector<Vector2f> velocities(input_count);
+		for (Vector2f& velocity : velocities)
+		{
+			const real32 angle = angleDist(rng);
+			velocity = Vector2f(cosf(angle), sinf(angle)) * move_speed;
+		}
+		const auto startMove = [&](uint32 i) {
+			player.position = freePoints[i % freePoints.size()];
+			player.velocity = velocities[at(i)];
+			player.xRemainder = 0;
+			player.yRemainder = 0;
+		};
+		runner.run(prefix + "move_6000px_s/std_function", 1 << 12, [&](uint32 i) {
+			startMove(i);
+			moveXByValue(player, player.velocity.x * move_time_delta, [&]() { player.velocity.x = -player.velocity.x; });
+			moveYByValue(player, player.velocity.y * move_time_delta, [&]() { player.velocity.y = -player.velocity.y; });
+			return (real64)(player.position.x + player.position.y);
+		});
+		runner.run(prefix + "move_6000px_s/function_ref", 1 << 12, [&](uint32 i) {
+			startMove(i);
+			player.moveX(player.velocity.x * move_time_delta, [&]() { player.velocity.x = -player.velocity.x; });
+			player.moveY(player.velocity.y * move_time_delta, [&]() { player.velocity.y = -player.velocity.y; });
+			return (real64)(player.position.x + player.position.y);
+		});
+	}
+	player.hitRect = hitRect;
+	player.velocity = {0, 0};
+
+	std::vector<Solid> tiles;
+	for (const Solid& solid : level->solids)
+	{
+		if (!solid.broken && !solid.doesMove)
+		{
+			tiles.push_back(solid);
+		}
+	}
+	if (!tiles.empty())
+	{
+		runner.run(prefix + "solid_prepare", 1 << 16, [&](uint32 i) {
+			Solid solid = tiles[i % tiles.size()];
+			solid.prepare(level);
+			return (real64)solid.collidable;
+		});
+	}
+
+	// Decoding the image, which happens once per run, and the copy from level_cache every new game makes
+	Level loaded;
+	runner.run(prefix + "level_parse", 4, [&](uint32) {
+		loaded.parse(level_filenames[levelIndex]);
+		return (real64)loaded.gridWidth;
+	});
+	runner.run(prefix + "level_load", 64, [&](uint32) {
+		loaded.load(level_filenames[levelIndex]);
+		return (real64)loaded.gridWidth;
+	});
+
+	level->unloadAllChunks();
+}
+
+static void runMovingSolidCases(BenchRunner& runner, std::mt19937& rng)
+{
+	const Level* source = &state->levels[0];
+	std::uniform_int_distribution<int32> iDist(1, source->gridWidth - 2);
+	std::uniform_int_distribution<int32> jDist(1, source->gridHeight - 2);
+	std::uniform_real_distribution<real32> xDist(0, (real32)source->width);
+	std::uniform_real_distribution<real32> yDist(0, (real32)source->height);
+
+	for (const uint32 solidCount : moving_solid_counts)
+	{
+		for (const uint32 actorCount : moving_actor_counts)
+		{
+			// Blocks go in empty cells with nothing around them, like level_gen places them
+			Level level;
+			level.load(level_filenames[0]);
+			for (uint32 chunk = 0; chunk < level.chunks.size(); ++chunk)
+			{
+				level.loadChunk(chunk);
+			}
+			state->currentLevel = &level;
+			for (uint32 placed = 0, tries = 0; placed < solidCount && tries < 100 * solidCount; ++tries)
+			{
+				const int32 i = iDist(rng);
+				const int32 j = jDist(rng);
+				const Rect2f around = {(real32)(i - 1) * LEVEL_SCALE, (real32)(j - 1) * LEVEL_SCALE, 3 * LEVEL_SCALE, 3 * LEVEL_SCALE};
+				if (!level.findSolid(around))
+				{
+					level.createSolid(Solid({(real32)i * LEVEL_SCALE, (real32)j * LEVEL_SCALE}, LEVEL_SCALE, LEVEL_SCALE, nullptr, true, false, true), i, j);
+					++placed;
+				}
+			}
+
+			std::vector<EnemyFish> enemies;
+			enemies.reserve(actorCount);
+			for (uint32 tries = 0; enemies.size() < actorCount && tries < 100 * actorCount; ++tries)
+			{
+				EnemyFish enemy({xDist(rng), yDist(rng)});
+				if (!enemy.collideAt(&level, enemy.position))
+				{
+					enemies.push_back(enemy);
+				}
+			}
+			state->AllActors.clear();
+			for (EnemyFish& enemy : enemies)
+			{
+				state->AllActors.push_back(&enemy);
+			}
+
+			const std::string name = "moving_solids/" + std::to_string(level.movingSolids.size()) + "_blocks_" +
+			                         std::to_string(enemies.size()) + "_enemies";
+			runner.run(name, 64, [&](uint32 i) {
+				// Squished enemies come back so every frame moves the same number of actors
+				for (EnemyFish& enemy : enemies)
+				{
+					enemy.isDead = false;
+				}
+				state->updateMovingSolids(move_time_delta);
+				frame_arena.reset();
+				return (real64)level.solids[level.movingSolids[i % level.movingSolids.size()]].position.y;
+			});
+			state->AllActors.clear();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int32 samples = default_samples;
+	const char* jsonFilename = nullptr;
+	const char* filter = nullptr;
+	for (int32 i = 1; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--samples=", 10) == 0)
+		{
+			samples = MAX(1, atoi(argv[i] + 10));
+		}
+		else if (strncmp(argv[i], "--json=", 7) == 0)
+		{
+			jsonFilename = argv[i] + 7;
+		}
+		else if (strncmp(argv[i], "--filter=", 9) == 0)
+		{
+			filter = argv[i] + 9;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [--samples=N] [--json=<file>] [--filter=<name substring>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (samples < 100)
+	{
+		fprintf(stderr, "With fewer than 100 samples the p99 is the slowest sample\n");
+	}
+
+	if (IMG_Init(IMG_INIT_PNG) == 0)
+	{
+		fprintf(stderr, "IMG_Init failed: %s\n", IMG_GetError());
+		return 1;
+	}
+
+	// collideAt warns on every hit, which would time the console instead of the query
+	SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_ERROR);
+
+	// The game state reads the levels from assets/, the textures stay null
+	state = new GameState();
+	state->waitForLevel(state->levels[3]);
+
+	std::mt19937 rng(1234);
+	BenchRunner runner(samples, filter);
+	printf("%-36s %12s %12s %10s %12s\n", "ns per call", "median", "p99", "mad", "min");
+	runMathCases(runner, rng);
+	for (int32 i = 0; i < 4; ++i)
+	{
+		runLevelCases(runner, rng, i);
+	}
+	runMovingSolidCases(runner, rng);
+
+	if (jsonFilename && !runner.writeJson(jsonFilename))
+	{
+		return 1;
+	}
+	IMG_Quit();
+	return 0;
+}
@@ -0,0 +1,174 @@
+// Line of sight microbenchmark: grid DDA (Level::raycast) against the segment tests the game had before,
+// checkAABBLineCollision against every tile, and against only the tiles inside the ray's bounding box.
+// Uses a random level with the same tile size as the game and rays up to the enemy sight distance long.
+//
+// Usage: raycast_bench [rays] [repeats]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+#include "definitions.h"
+
+GameState* state = nullptr;
+
+// Defined by game.cpp, nothing here reaches them
+void changeCurrentState(State) {}
+void emitBlockDebris(const Rect2f&, Vector2f) {}
+void emitBubblePop(Vector2f, real32) {}
+void clearParticles() {}
+
+constexpr int32 grid_width = 400;
+constexpr int32 grid_height = 200;
+constexpr real32 tile_density = 0.2f;
+constexpr real32 max_ray_length = 1800;
+
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchRay
+{
+	Vector2f from;
+	Vector2f to;
+};
+
+static real64 getNsPerRay(BenchClock::time_point start, size_t rays)
+{
+	return (real64)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count() / rays;
+}
+
+static Vector2f randomFreePoint(const Level& level, std::mt19937& rng)
+{
+	std::uniform_real_distribution<real32> xDist(0, grid_width * LEVEL_SCALE);
+	std::uniform_real_distribution<real32> yDist(0, grid_height * LEVEL_SCALE);
+	while (true)
+	{
+		const Vector2f point = {xDist(rng), yDist(rng)};
+		if (!level.isCellBlocked((int32)(point.x / LEVEL_SCALE), (int32)(point.y / LEVEL_SCALE)))
+		{
+			return point;
+		}
+	}
+}
+
+static bool segmentTestAll(const Level& level, const BenchRay& ray)
+{
+	for (const Solid& solid : level.solids)
+	{
+		if (checkAABBLineCollision(ray.from, ray.to, {solid.position.x, solid.position.y, solid.width, solid.height}))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool segmentTestBoundingBox(const Level& level, const BenchRay& ray)
+{
+	const int32 left = (int32)(MIN(ray.from.x, ray.to.x) / LEVEL_SCALE);
+	const int32 right = (int32)(MAX(ray.from.x, ray.to.x) / LEVEL_SCALE);
+	const int32 top = (int32)(MIN(ray.from.y, ray.to.y) / LEVEL_SCALE);
+	const int32 bottom = (int32)(MAX(ray.from.y, ray.to.y) / LEVEL_SCALE);
+	for (int32 y = top; y <= bottom; ++y)
+	{
+		for (int32 x = left; x <= right; ++x)
+		{
+			if (level.isCellBlocked(x, y) &&
+				checkAABBLineCollision(ray.from, ray.to, {(real32)x * LEVEL_SCALE, (real32)y * LEVEL_SCALE, LEVEL_SCALE, LEVEL_SCALE}))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	const size_t rayCount = argc > 1 ? (size_t)atoi(argv[1]) : 4096;
+	const int32 repeats = argc > 2 ? atoi(argv[2]) : 20;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<real32> unit(0, 1);
+
+	Level level;
+	level.width = grid_width * LEVEL_SCALE;
+	level.height = grid_height * LEVEL_SCALE;
+	level.gridWidth = grid_width;
+	level.gridHeight = grid_height;
+	level.blockedCells.assign(grid_width * grid_height, 0);
+	level.solids.reserve(grid_width * grid_height);
+	for (int32 y = 0; y < grid_height; ++y)
+	{
+		for (int32 x = 0; x < grid_width; ++x)
+		{
+			if (unit(rng) < tile_density)
+			{
+				level.blockedCells[y * grid_width + x] = 1;
+				level.solids.emplace_back(Vector2f((real32)x * LEVEL_SCALE, (real32)y * LEVEL_SCALE), LEVEL_SCALE, LEVEL_SCALE, nullptr);
+			}
+		}
+	}
+
+	std::vector<BenchRay> rays(rayCount);
+	std::uniform_real_distribution<real32> angleDist(0, 2 * Pi32);
+	std::uniform_real_distribution<real32> lengthDist(LEVEL_SCALE, max_ray_length);
+	for (BenchRay& ray : rays)
+	{
+		do
+		{
+			ray.from = randomFreePoint(level, rng);
+			const real32 angle = angleDist(rng);
+			ray.to = ray.from + Vector2f(cosf(angle), sinf(angle)) * lengthDist(rng);
+		} while (ray.to.x < 0 || ray.to.y < 0 || ray.to.x >= level.width || ray.to.y >= level.height ||
+		         level.isCellBlocked((int32)(ray.to.x / LEVEL_SCALE), (int32)(ray.to.y / LEVEL_SCALE)));
+	}
+
+	std::vector<uint8> ddaBlocked(rayCount);
+	auto start = BenchClock::now();
+	for (int32 r = 0; r < repeats; ++r)
+	{
+		for (size_t i = 0; i < rayCount; ++i)
+		{
+			ddaBlocked[i] = level.raycast(rays[i].from, rays[i].to);
+		}
+	}
+	const real64 ddaNs = getNsPerRay(start, rayCount * repeats);
+
+	std::vector<uint8> boxBlocked(rayCount);
+	start = BenchClock::now();
+	for (size_t i = 0; i < rayCount; ++i)
+	{
+		boxBlocked[i] = segmentTestBoundingBox(level, rays[i]);
+	}
+	const real64 boxNs = getNsPerRay(start, rayCount);
+
+	// Every tile for every ray is slow, a subset is enough for a stable number
+	const size_t allCount = MIN(rayCount, (size_t)256);
+	std::vector<uint8> allBlocked(allCount);
+	start = BenchClock::now();
+	for (size_t i = 0; i < allCount; ++i)
+	{
+		allBlocked[i] = segmentTestAll(level, rays[i]);
+	}
+	const real64 allNs = getNsPerRay(start, allCount);
+
+	size_t blockedCount = 0;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < rayCount; ++i)
+	{
+		blockedCount += ddaBlocked[i];
+		mismatches += ddaBlocked[i] != boxBlocked[i];
+	}
+
+	printf("%dx%d cells, %zu tiles, %zu rays, %zu blocked\n", grid_width, grid_height, level.solids.size(), rayCount, blockedCount);
+	printf("dda                   %10.1f ns/ray\n", ddaNs);
+	printf("segments in ray box   %10.1f ns/ray\n", boxNs);
+	printf("segments all tiles    %10.1f ns/ray (%zu rays)\n", allNs, allCount);
+	printf("dda and segment results differ on %zu rays (grazing corners)\n", mismatches);
+	return 0;
+}
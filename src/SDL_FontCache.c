@@ -273,143 +273,137 @@ FC_GlyphData FC_MakeGlyphData(int cache_level, Sint16 x, Sint16 y, Uint16 w, Uin
     return gd;
 }
 
-// Enough to hold all of the ascii characters and some.
-#define FC_DEFAULT_NUM_BUCKETS 300
+// Glyph lookup table.  ASCII codepoints index a flat array directly, everything else
+// goes into an open addressing (linear probing) table, so a lookup is at most a short
+// scan over contiguous memory instead of a walk over malloc'd list nodes.
+#define FC_MAP_DIRECT_SIZE 128
+#define FC_MAP_INITIAL_CAPACITY 64
+#define FC_MAP_EMPTY_KEY 0xFFFFFFFF
 
-typedef struct FC_MapNode
+typedef struct FC_MapSlot
 {
     Uint32 key;
     FC_GlyphData value;
-    struct FC_MapNode* next;
 
-} FC_MapNode;
+} FC_MapSlot;
 
 typedef struct FC_Map
 {
-    int num_buckets;
-    FC_MapNode** buckets;
+    Uint8 direct_used[FC_MAP_DIRECT_SIZE];
+    FC_GlyphData direct[FC_MAP_DIRECT_SIZE];
+    int num_direct;
+
+    // Power of two, kept at most half full
+    int capacity;
+    int count;
+    FC_MapSlot* slots;
 } FC_Map;
 
 
 
-static FC_Map* FC_MapCreate(int num_buckets)
+static_inline Uint32 FC_MapHash(Uint32 codepoint, int capacity)
+{
+    return (codepoint * 2654435761u) & (Uint32)(capacity - 1);
+}
+
+static FC_MapSlot* FC_MapAllocSlots(int capacity)
 {
     int i;
-    FC_Map* map = (FC_Map*)malloc(sizeof(FC_Map));
+    FC_MapSlot* slots = (FC_MapSlot*)malloc(capacity * sizeof(FC_MapSlot));
+    for(i = 0; i < capacity; ++i)
+        slots[i].key = FC_MAP_EMPTY_KEY;
+    return slots;
+}
 
-    map->num_buckets = num_buckets;
-    map->buckets = (FC_MapNode**)malloc(num_buckets * sizeof(FC_MapNode*));
+static FC_Map* FC_MapCreate(int capacity)
+{
+    FC_Map* map = (FC_Map*)malloc(sizeof(FC_Map));
 
-    for(i = 0; i < num_buckets; ++i)
-    {
-        map->buckets[i] = NULL;
-    }
+    memset(map->direct_used, 0, sizeof(map->direct_used));
+    map->num_direct = 0;
+    map->capacity = capacity;
+    map->count = 0;
+    map->slots = FC_MapAllocSlots(capacity);
 
     return map;
 }
 
-/*static void FC_MapClear(FC_Map* map)
+static void FC_MapFree(FC_Map* map)
 {
-    int i;
     if(map == NULL)
         return;
 
-    // Go through each bucket
-    for(i = 0; i < map->num_buckets; ++i)
-    {
-        // Delete the nodes in order
-        FC_MapNode* node = map->buckets[i];
-        while(node != NULL)
-        {
-            FC_MapNode* last = node;
-            node = node->next;
-            free(last);
-        }
-        // Set the bucket to empty
-        map->buckets[i] = NULL;
-    }
-}*/
+    free(map->slots);
+    free(map);
+}
 
-static void FC_MapFree(FC_Map* map)
+static FC_MapSlot* FC_MapProbe(FC_MapSlot* slots, int capacity, Uint32 codepoint)
+{
+    Uint32 index = FC_MapHash(codepoint, capacity);
+    while(slots[index].key != FC_MAP_EMPTY_KEY && slots[index].key != codepoint)
+        index = (index + 1) & (Uint32)(capacity - 1);
+    return &slots[index];
+}
+
+static void FC_MapGrow(FC_Map* map)
 {
     int i;
-    if(map == NULL)
-        return;
+    int new_capacity = map->capacity * 2;
+    FC_MapSlot* new_slots = FC_MapAllocSlots(new_capacity);
 
-    // Go through each bucket
-    for(i = 0; i < map->num_buckets; ++i)
+    for(i = 0; i < map->capacity; ++i)
     {
-        // Delete the nodes in order
-        FC_MapNode* node = map->buckets[i];
-        while(node != NULL)
-        {
-            FC_MapNode* last = node;
-            node = node->next;
-            free(last);
-        }
+        if(map->slots[i].key != FC_MAP_EMPTY_KEY)
+            *FC_MapProbe(new_slots, new_capacity, map->slots[i].key) = map->slots[i];
     }
 
-    free(map->buckets);
-    free(map);
+    free(map->slots);
+    map->slots = new_slots;
+    map->capacity = new_capacity;
 }
 
-// Note: Does not handle duplicates in any special way.
+// Note: Replaces the existing data for duplicates.  The returned pointer is only valid until the next insert.
 static FC_GlyphData* FC_MapInsert(FC_Map* map, Uint32 codepoint, FC_GlyphData glyph)
 {
-    Uint32 index;
-    FC_MapNode* node;
-    if(map == NULL)
+    FC_MapSlot* slot;
+    if(map == NULL || codepoint == FC_MAP_EMPTY_KEY)
         return NULL;
 
-    // Get index for bucket
-    index = codepoint % map->num_buckets;
-
-    // If this bucket is empty, create a node and return its value
-    if(map->buckets[index] == NULL)
+    if(codepoint < FC_MAP_DIRECT_SIZE)
     {
-        node = map->buckets[index] = (FC_MapNode*)malloc(sizeof(FC_MapNode));
-        node->key = codepoint;
-        node->value = glyph;
-        node->next = NULL;
-        return &node->value;
-    }
-
-    for(node = map->buckets[index]; node != NULL; node = node->next)
-    {
-        // Find empty node and add a new one on.
-        if(node->next == NULL)
+        if(!map->direct_used[codepoint])
         {
-            node->next = (FC_MapNode*)malloc(sizeof(FC_MapNode));
-            node = node->next;
-
-            node->key = codepoint;
-            node->value = glyph;
-            node->next = NULL;
-            return &node->value;
+            map->direct_used[codepoint] = 1;
+            map->num_direct++;
         }
+        map->direct[codepoint] = glyph;
+        return &map->direct[codepoint];
     }
 
-    return NULL;
+    if((map->count + 1) * 2 > map->capacity)
+        FC_MapGrow(map);
+
+    slot = FC_MapProbe(map->slots, map->capacity, codepoint);
+    if(slot->key == FC_MAP_EMPTY_KEY)
+    {
+        slot->key = codepoint;
+        map->count++;
+    }
+    slot->value = glyph;
+    return &slot->value;
 }
 
-static FC_GlyphData* FC_MapFind(FC_Map* map, Uint32 codepoint)
+static_inline FC_GlyphData* FC_MapFind(FC_Map* map, Uint32 codepoint)
 {
-    Uint32 index;
-    FC_MapNode* node;
+    FC_MapSlot* slot;
     if(map == NULL)
         return NULL;
 
-    // Get index for bucket
-    index = codepoint % map->num_buckets;
-
-    // Go through list until we find a match
-    for(node = map->buckets[index]; node != NULL; node = node->next)
-    {
-        if(node->key == codepoint)
-            return &node->value;
-    }
+    if(codepoint < FC_MAP_DIRECT_SIZE)
+        return map->direct_used[codepoint]? &map->direct[codepoint] : NULL;
 
-    return NULL;
+    slot = FC_MapProbe(map->slots, map->capacity, codepoint);
+    return (slot->key == codepoint)? &slot->value : NULL;
 }
 
 
@@ -423,6 +417,11 @@ struct FC_Font
     TTF_Font* ttf_source;  // TTF_Font source of characters
     Uint8 owns_ttf_source;  // Can we delete the TTF_Font ourselves?
 
+    // Fallback for baked fonts, opened into ttf_source the first time a glyph is missing
+    char* ttf_filename;
+    Uint32 ttf_point_size;
+    int ttf_style;
+
     FC_FilterEnum filter;
 
     SDL_Color default_color;
@@ -454,6 +453,7 @@ static FC_GlyphData* FC_PackGlyphData(FC_Font* font, Uint32 codepoint, Uint16 wi
 
 
 static FC_Rect FC_RenderLeft(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text);
+static FC_Rect FC_RenderLeftN(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text, const char* end);
 static FC_Rect FC_RenderCenter(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text);
 static FC_Rect FC_RenderRight(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text);
 
@@ -873,7 +873,7 @@ static void FC_Init(FC_Font* font)
     if(font->glyphs != NULL)
         FC_MapFree(font->glyphs);
 
-    font->glyphs = FC_MapCreate(FC_DEFAULT_NUM_BUCKETS);
+    font->glyphs = FC_MapCreate(FC_MAP_INITIAL_CAPACITY);
 
     font->glyph_cache_size = 3;
     font->glyph_cache_count = 0;
@@ -1138,12 +1138,132 @@ FC_Font* FC_CreateFont(void)
 // Assume this many will be enough...
 #define FC_LOAD_MAX_SURFACES 10
 
+// Bump when the baked metrics format changes
+#define FC_BAKED_VERSION 1
+
+static void FC_SetMetricsFromTTF(FC_Font* font, TTF_Font* ttf)
+{
+    //font->line_height = TTF_FontLineSkip(ttf);
+    font->height = TTF_FontHeight(ttf);
+    font->ascent = TTF_FontAscent(ttf);
+    font->descent = -TTF_FontDescent(ttf);
+    
+    // Some bug for certain fonts can result in an incorrect height.
+    if(font->height < font->ascent - font->descent)
+        font->height = font->ascent - font->descent;
+
+    font->baseline = font->height - font->descent;
+}
+
+int FC_BakeFontSurfaces(FC_Font* font, TTF_Font* ttf, SDL_Surface** surfaces, int max_surfaces)
+{
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface* glyph_surf;
+    char buff[5];
+    const char* buff_ptr = buff;
+    const char* source_string;
+    Uint8 packed = 0;
+    unsigned int w, h;
+    int num_surfaces = 1;
+
+    if(font == NULL || ttf == NULL || surfaces == NULL || max_surfaces < 1)
+        return 0;
+
+    FC_SetMetricsFromTTF(font, ttf);
+
+    // Copy glyphs from the surface to the font texture and store the position data
+    // Pack row by row into a square texture
+    // Try figuring out dimensions that make sense for the font size.
+    w = font->height*12;
+    h = font->height*12;
+    surfaces[0] = FC_CreateSurface32(w, h);
+    font->last_glyph.rect.x = FC_CACHE_PADDING;
+    font->last_glyph.rect.y = FC_CACHE_PADDING;
+    font->last_glyph.rect.w = 0;
+    font->last_glyph.rect.h = font->height;
+
+    source_string = font->loading_string;
+    for(; *source_string != '\0'; source_string = U8_next(source_string))
+    {
+        memset(buff, 0, 5);
+        if(!U8_charcpy(buff, source_string, 5))
+            continue;
+        glyph_surf = TTF_RenderUTF8_Blended(ttf, buff, white);
+        if(glyph_surf == NULL)
+            continue;
+
+        // Try packing.  If it fails, start a new surface for the next cache level.
+        packed = (FC_PackGlyphData(font, FC_GetCodepointFromUTF8(&buff_ptr, 0), glyph_surf->w, surfaces[num_surfaces-1]->w, surfaces[num_surfaces-1]->h) != NULL);
+        if(!packed)
+        {
+            if(num_surfaces >= max_surfaces)
+            {
+                // Can't do any more!
+                FC_Log("SDL_FontCache error: Could not create enough cache surfaces to fit all of the loading string!\n");
+                SDL_FreeSurface(glyph_surf);
+                break;
+            }
+
+            // Update the glyph cursor to the new cache level.
+            font->last_glyph.cache_level = num_surfaces;
+
+            surfaces[num_surfaces] = FC_CreateSurface32(w, h);
+            num_surfaces++;
+        }
+
+        // Try packing for the new surface, then blit onto it.
+        if(packed || FC_PackGlyphData(font, FC_GetCodepointFromUTF8(&buff_ptr, 0), glyph_surf->w, surfaces[num_surfaces-1]->w, surfaces[num_surfaces-1]->h) != NULL)
+        {
+            SDL_SetSurfaceBlendMode(glyph_surf, SDL_BLENDMODE_NONE);
+            SDL_Rect srcRect = {0, 0, glyph_surf->w, glyph_surf->h};
+            SDL_Rect destrect = font->last_glyph.rect;
+            SDL_BlitSurface(glyph_surf, &srcRect, surfaces[num_surfaces-1], &destrect);
+        }
+
+        SDL_FreeSurface(glyph_surf);
+    }
+
+    return num_surfaces;
+}
+
+// Uploads baked cache levels in order and frees the surfaces
+static Uint8 FC_UploadBakedSurfaces(FC_Font* font, SDL_Surface** surfaces, int num_surfaces)
+{
+    Uint8 result = 1;
+    int i;
+    for(i = 0; i < num_surfaces; ++i)
+    {
+        if(!FC_UploadGlyphCache(font, i, surfaces[i]))
+            result = 0;
+        SDL_FreeSurface(surfaces[i]);
+        #ifndef FC_USE_SDL_GPU
+        if(i < font->glyph_cache_count)
+            SDL_SetTextureBlendMode(font->glyph_cache[i], SDL_BLENDMODE_BLEND);
+        #endif
+    }
+    return result;
+}
+
+static void FC_CheckRenderTargetSupport(FC_Font* font)
+{
+    #ifdef FC_USE_SDL_GPU
+    fc_has_render_target_support = GPU_IsFeatureEnabled(GPU_FEATURE_RENDER_TARGETS);
+    #else
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(font->renderer, &info);
+    fc_has_render_target_support = (info.flags & SDL_RENDERER_TARGETTEXTURE);
+    #endif
+}
+
 #ifdef FC_USE_SDL_GPU
 Uint8 FC_LoadFontFromTTF(FC_Font* font, TTF_Font* ttf, SDL_Color color)
 #else
 Uint8 FC_LoadFontFromTTF(FC_Font* font, SDL_Renderer* renderer, TTF_Font* ttf, SDL_Color color)
 #endif
 {
+    SDL_Surface* surfaces[FC_LOAD_MAX_SURFACES];
+    int num_surfaces;
+
     if(font == NULL || ttf == NULL)
         return 0;
     #ifndef FC_USE_SDL_GPU
@@ -1153,107 +1273,122 @@ Uint8 FC_LoadFontFromTTF(FC_Font* font, SDL_Renderer* renderer, TTF_Font* ttf, S
 
     FC_ClearFont(font);
 
-
-    // Might as well check render target support here
-    #ifdef FC_USE_SDL_GPU
-    fc_has_render_target_support = GPU_IsFeatureEnabled(GPU_FEATURE_RENDER_TARGETS);
-    #else
-    SDL_RendererInfo info;
-    SDL_GetRendererInfo(renderer, &info);
-    fc_has_render_target_support = (info.flags & SDL_RENDERER_TARGETTEXTURE);
-
+    #ifndef FC_USE_SDL_GPU
     font->renderer = renderer;
     #endif
 
+    // Might as well check render target support here
+    FC_CheckRenderTargetSupport(font);
+
     font->ttf_source = ttf;
+    font->default_color = color;
 
-    //font->line_height = TTF_FontLineSkip(ttf);
-    font->height = TTF_FontHeight(ttf);
-    font->ascent = TTF_FontAscent(ttf);
-    font->descent = -TTF_FontDescent(ttf);
-    
-    // Some bug for certain fonts can result in an incorrect height.
-    if(font->height < font->ascent - font->descent)
-        font->height = font->ascent - font->descent;
+    num_surfaces = FC_BakeFontSurfaces(font, ttf, surfaces, FC_LOAD_MAX_SURFACES);
+    FC_UploadBakedSurfaces(font, surfaces, num_surfaces);
 
-    font->baseline = font->height - font->descent;
+    return 1;
+}
 
-    font->default_color = color;
+char* FC_GetBakedMetrics(FC_Font* font)
+{
+    unsigned int num_codepoints;
+    Uint32* codepoints;
+    char* result;
+    int size, pos;
+    unsigned int i;
+
+    if(font == NULL)
+        return NULL;
+
+    num_codepoints = FC_GetNumCodepoints(font);
+    codepoints = (Uint32*)malloc((num_codepoints + 1) * sizeof(Uint32));
+    FC_GetCodepoints(font, codepoints);
 
+    // Header lines plus one line per glyph, each well under 80 characters
+    size = 256 + num_codepoints*80;
+    result = (char*)malloc(size);
+    pos = snprintf(result, size, "SDL_FontCache %d\nheight %d ascent %d descent %d baseline %d\nlevels %d\ncursor %d %d %d %d\n",
+                   FC_BAKED_VERSION, font->height, font->ascent, font->descent, font->baseline,
+                   font->last_glyph.cache_level + 1, font->last_glyph.cache_level, font->last_glyph.rect.x, font->last_glyph.rect.y, font->last_glyph.rect.w);
+
+    for(i = 0; i < num_codepoints && pos < size; ++i)
     {
-        SDL_Color white = {255, 255, 255, 255};
-        SDL_Surface* glyph_surf;
-        char buff[5];
-        const char* buff_ptr = buff;
-        const char* source_string;
-        Uint8 packed = 0;
-
-        // Copy glyphs from the surface to the font texture and store the position data
-        // Pack row by row into a square texture
-        // Try figuring out dimensions that make sense for the font size.
-        unsigned int w = font->height*12;
-        unsigned int h = font->height*12;
-        SDL_Surface* surfaces[FC_LOAD_MAX_SURFACES];
-        int num_surfaces = 1;
-        surfaces[0] = FC_CreateSurface32(w, h);
-        font->last_glyph.rect.x = FC_CACHE_PADDING;
-        font->last_glyph.rect.y = FC_CACHE_PADDING;
-        font->last_glyph.rect.w = 0;
-        font->last_glyph.rect.h = font->height;
-
-        source_string = font->loading_string;
-        for(; *source_string != '\0'; source_string = U8_next(source_string))
-        {
-            memset(buff, 0, 5);
-            if(!U8_charcpy(buff, source_string, 5))
-                continue;
-            glyph_surf = TTF_RenderUTF8_Blended(ttf, buff, white);
-            if(glyph_surf == NULL)
-                continue;
+        FC_GlyphData* glyph = FC_MapFind(font->glyphs, codepoints[i]);
+        pos += snprintf(result + pos, size - pos, "glyph %u %d %d %d %d %d\n", codepoints[i], glyph->cache_level,
+                        (int)glyph->rect.x, (int)glyph->rect.y, (int)glyph->rect.w, (int)glyph->rect.h);
+    }
 
-            // Try packing.  If it fails, create a new surface for the next cache level.
-            packed = (FC_PackGlyphData(font, FC_GetCodepointFromUTF8(&buff_ptr, 0), glyph_surf->w, surfaces[num_surfaces-1]->w, surfaces[num_surfaces-1]->h) != NULL);
-            if(!packed)
-            {
-                int i = num_surfaces-1;
-                if(num_surfaces >= FC_LOAD_MAX_SURFACES)
-                {
-                    // Can't do any more!
-                    FC_Log("SDL_FontCache error: Could not create enough cache surfaces to fit all of the loading string!\n");
-                    SDL_FreeSurface(glyph_surf);
-                    break;
-                }
+    free(codepoints);
+    return result;
+}
 
-                // Upload the current surface to the glyph cache now so we can keep the cache level packing cursor up to date as we go.
-                FC_UploadGlyphCache(font, i, surfaces[i]);
-                SDL_FreeSurface(surfaces[i]);
-                #ifndef FC_USE_SDL_GPU
-                SDL_SetTextureBlendMode(font->glyph_cache[i], SDL_BLENDMODE_BLEND);
-                #endif
-                // Update the glyph cursor to the new cache level.  We need to do this here because the actual cache lags behind our use of the packing above.
-                font->last_glyph.cache_level = num_surfaces;
+#ifdef FC_USE_SDL_GPU
+Uint8 FC_LoadFontFromBaked(FC_Font* font, SDL_Surface** cache_levels, int num_levels, const char* metrics, SDL_Color color)
+#else
+Uint8 FC_LoadFontFromBaked(FC_Font* font, FC_Target* renderer, SDL_Surface** cache_levels, int num_levels, const char* metrics, SDL_Color color)
+#endif
+{
+    int version, height, ascent, descent, baseline, levels;
+    int cursor_level, cursor_x, cursor_y, cursor_w;
+    int offset = 0;
+    const char* c;
 
+    if(font == NULL || cache_levels == NULL || metrics == NULL)
+        return 0;
+    #ifndef FC_USE_SDL_GPU
+    if(renderer == NULL)
+        return 0;
+    #endif
 
-                surfaces[num_surfaces] = FC_CreateSurface32(w, h);
-                num_surfaces++;
-            }
+    if(sscanf(metrics, "SDL_FontCache %d height %d ascent %d descent %d baseline %d levels %d cursor %d %d %d %d%n",
+              &version, &height, &ascent, &descent, &baseline, &levels,
+              &cursor_level, &cursor_x, &cursor_y, &cursor_w, &offset) != 10 || version != FC_BAKED_VERSION)
+    {
+        FC_Log("SDL_FontCache error: Baked font metrics are missing or from another version.\n");
+        return 0;
+    }
+    if(levels != num_levels)
+    {
+        FC_Log("SDL_FontCache error: Baked font has %d cache levels, but %d were given.\n", levels, num_levels);
+        return 0;
+    }
 
-            // Try packing for the new surface, then blit onto it.
-            if(packed || FC_PackGlyphData(font, FC_GetCodepointFromUTF8(&buff_ptr, 0), glyph_surf->w, surfaces[num_surfaces-1]->w, surfaces[num_surfaces-1]->h) != NULL)
-            {
-                SDL_SetSurfaceBlendMode(glyph_surf, SDL_BLENDMODE_NONE);
-                SDL_Rect srcRect = {0, 0, glyph_surf->w, glyph_surf->h};
-                SDL_Rect destrect = font->last_glyph.rect;
-                SDL_BlitSurface(glyph_surf, &srcRect, surfaces[num_surfaces-1], &destrect);
-            }
+    FC_ClearFont(font);
 
-            SDL_FreeSurface(glyph_surf);
-        }
+    #ifndef FC_USE_SDL_GPU
+    font->renderer = renderer;
+    #endif
+    FC_CheckRenderTargetSupport(font);
+
+    font->height = height;
+    font->ascent = ascent;
+    font->descent = descent;
+    font->baseline = baseline;
+    font->default_color = color;
+
+    for(c = metrics + offset; ; )
+    {
+        unsigned int codepoint;
+        int level, x, y, w, h, n = 0;
+        if(sscanf(c, " glyph %u %d %d %d %d %d%n", &codepoint, &level, &x, &y, &w, &h, &n) != 6 || n == 0)
+            break;
+        FC_SetGlyphData(font, codepoint, FC_MakeGlyphData(level, x, y, w, h));
+        c += n;
+    }
+
+    font->last_glyph.cache_level = cursor_level;
+    font->last_glyph.rect.x = cursor_x;
+    font->last_glyph.rect.y = cursor_y;
+    font->last_glyph.rect.w = cursor_w;
+    font->last_glyph.rect.h = font->height;
 
+    // The caller still owns the surfaces
+    {
+        int i;
+        for(i = 0; i < num_levels; ++i)
         {
-            int i = num_surfaces-1;
-            FC_UploadGlyphCache(font, i, surfaces[i]);
-            SDL_FreeSurface(surfaces[i]);
+            if(!FC_UploadGlyphCache(font, i, cache_levels[i]))
+                return 0;
             #ifndef FC_USE_SDL_GPU
             SDL_SetTextureBlendMode(font->glyph_cache[i], SDL_BLENDMODE_BLEND);
             #endif
@@ -1263,6 +1398,55 @@ Uint8 FC_LoadFontFromTTF(FC_Font* font, SDL_Renderer* renderer, TTF_Font* ttf, S
     return 1;
 }
 
+void FC_SetFallbackFont(FC_Font* font, const char* filename_ttf, Uint32 pointSize, int style)
+{
+    if(font == NULL)
+        return;
+
+    free(font->ttf_filename);
+    font->ttf_filename = (filename_ttf != NULL? U8_strdup(filename_ttf) : NULL);
+    font->ttf_point_size = pointSize;
+    font->ttf_style = style;
+}
+
+// Opens the fallback TTF of a baked font.  Only tried once, so a missing file doesn't cost anything per frame.
+static Uint8 FC_OpenFallbackFont(FC_Font* font)
+{
+    TTF_Font* ttf;
+    int style = font->ttf_style;
+
+    if(font->ttf_filename == NULL)
+        return 0;
+
+    if(!TTF_WasInit() && TTF_Init() < 0)
+    {
+        FC_Log("Unable to initialize SDL_ttf: %s \n", TTF_GetError());
+        ttf = NULL;
+    }
+    else
+        ttf = TTF_OpenFont(font->ttf_filename, font->ttf_point_size);
+
+    free(font->ttf_filename);
+    font->ttf_filename = NULL;
+
+    if(ttf == NULL)
+    {
+        FC_Log("Unable to load TrueType font: %s \n", TTF_GetError());
+        return 0;
+    }
+
+    if(style & TTF_STYLE_OUTLINE)
+    {
+        style &= ~TTF_STYLE_OUTLINE;
+        TTF_SetFontOutline(ttf, 1);
+    }
+    TTF_SetFontStyle(ttf, style);
+
+    font->ttf_source = ttf;
+    font->owns_ttf_source = 1;
+    return 1;
+}
+
 
 #ifdef FC_USE_SDL_GPU
 Uint8 FC_LoadFont(FC_Font* font, const char* filename_ttf, Uint32 pointSize, SDL_Color color, int style)
@@ -1369,6 +1553,13 @@ void FC_ResetFontFromRendererReset(FC_Font* font, SDL_Renderer* renderer, Uint32
     owns_ttf = font->owns_ttf_source;
     FC_Init(font);
 
+    // A baked font that never needed its TTF has to open it now to rebuild the cache
+    if (!owns_ttf && font->ttf_filename != NULL && FC_OpenFallbackFont(font)) {
+        ttf = font->ttf_source;
+        owns_ttf = 1;
+        font->owns_ttf_source = 0;
+    }
+
     // Can only reload glyphs if we own the SDL_RWops.
     if (owns_ttf)
         FC_LoadFontFromTTF(font, renderer, ttf, col);
@@ -1389,6 +1580,9 @@ void FC_ClearFont(FC_Font* font)
     font->owns_ttf_source = 0;
     font->ttf_source = NULL;
 
+    free(font->ttf_filename);
+    font->ttf_filename = NULL;
+
     // Delete glyph map
     FC_MapFree(font->glyphs);
     font->glyphs = NULL;
@@ -1435,6 +1629,7 @@ void FC_FreeFont(FC_Font* font)
     free(font->glyph_cache);
 
     free(font->loading_string);
+    free(font->ttf_filename);
 
     free(font);
 }
@@ -1517,24 +1712,10 @@ Uint8 FC_AddGlyphToCache(FC_Font* font, SDL_Surface* glyph_surface)
 
 unsigned int FC_GetNumCodepoints(FC_Font* font)
 {
-    FC_Map* glyphs;
-    int i;
-    unsigned int result = 0;
     if(font == NULL || font->glyphs == NULL)
         return 0;
 
-    glyphs = font->glyphs;
-
-    for(i = 0; i < glyphs->num_buckets; ++i)
-    {
-        FC_MapNode* node;
-        for(node = glyphs->buckets[i]; node != NULL; node = node->next)
-        {
-            result++;
-        }
-    }
-
-    return result;
+    return font->glyphs->num_direct + font->glyphs->count;
 }
 
 void FC_GetCodepoints(FC_Font* font, Uint32* result)
@@ -1547,12 +1728,20 @@ void FC_GetCodepoints(FC_Font* font, Uint32* result)
 
     glyphs = font->glyphs;
 
-    for(i = 0; i < glyphs->num_buckets; ++i)
+    for(i = 0; i < FC_MAP_DIRECT_SIZE; ++i)
     {
-        FC_MapNode* node;
-        for(node = glyphs->buckets[i]; node != NULL; node = node->next)
+        if(glyphs->direct_used[i])
         {
-            result[count] = node->key;
+            result[count] = i;
+            count++;
+        }
+    }
+
+    for(i = 0; i < glyphs->capacity; ++i)
+    {
+        if(glyphs->slots[i].key != FC_MAP_EMPTY_KEY)
+        {
+            result[count] = glyphs->slots[i].key;
             count++;
         }
     }
@@ -1569,7 +1758,7 @@ Uint8 FC_GetGlyphData(FC_Font* font, FC_GlyphData* result, Uint32 codepoint)
         SDL_Surface* surf;
         FC_Image* cache_image;
 
-        if(font->ttf_source == NULL)
+        if(font->ttf_source == NULL && !FC_OpenFallbackFont(font))
             return 0;
 
         FC_GetUTF8FromCodepoint(buff, codepoint);
@@ -1630,7 +1819,21 @@ FC_GlyphData* FC_SetGlyphData(FC_Font* font, Uint32 codepoint, FC_GlyphData glyp
 
 
 // Drawing
+static_inline const char* FC_GetTextEnd(const char* text, int length)
+{
+    return text + (length < 0? strlen(text) : (size_t)length);
+}
+
 static FC_Rect FC_RenderLeft(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text)
+{
+    if(text == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    return FC_RenderLeftN(font, dest, x, y, scale, text, FC_GetTextEnd(text, -1));
+}
+
+// Renders [text, end) without any formatting
+static FC_Rect FC_RenderLeftN(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, const char* text, const char* end)
 {
     const char* c = text;
     FC_Rect srcRect;
@@ -1658,7 +1861,7 @@ static FC_Rect FC_RenderLeft(FC_Font* font, FC_Target* dest, float x, float y, F
 
     int newlineX = x;
 
-    for(; *c != '\0'; c++)
+    for(; c < end; c++)
     {
         if(*c == '\n')
         {
@@ -1732,6 +1935,201 @@ FC_Rect FC_Draw(FC_Font* font, FC_Target* dest, float x, float y, const char* fo
 
 
 
+
+// Unformatted rendering
+
+// Renders each line of [text, end) with the given alignment
+static FC_Rect FC_RenderAlignN(FC_Font* font, FC_Target* dest, float x, float y, FC_Scale scale, FC_AlignEnum align, const char* text, const char* end)
+{
+    FC_Rect result = FC_MakeRect(x, y, 0, 0);
+    const char* line = text;
+    const char* c;
+
+    for(c = text; ; c++)
+    {
+        if(c == end || *c == '\n')
+        {
+            float line_x = x;
+            if(align == FC_ALIGN_CENTER)
+                line_x -= scale.x*FC_GetTextWidth(font, line, (int)(c - line))/2.0f;
+            else if(align == FC_ALIGN_RIGHT)
+                line_x -= scale.x*FC_GetTextWidth(font, line, (int)(c - line));
+
+            result = FC_RectUnion(FC_RenderLeftN(font, dest, line_x, y, scale, line, c), result);
+            if(c == end)
+                break;
+
+            line = c + 1;
+            y += scale.y*font->height;
+        }
+    }
+
+    return result;
+}
+
+FC_Rect FC_DrawText(FC_Font* font, FC_Target* dest, float x, float y, const char* text, int length)
+{
+    if(text == NULL || font == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    set_color_for_all_caches(font, font->default_color);
+
+    return FC_RenderLeftN(font, dest, x, y, FC_MakeScale(1,1), text, FC_GetTextEnd(text, length));
+}
+
+FC_Rect FC_DrawTextColor(FC_Font* font, FC_Target* dest, float x, float y, SDL_Color color, const char* text, int length)
+{
+    if(text == NULL || font == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    set_color_for_all_caches(font, color);
+
+    return FC_RenderLeftN(font, dest, x, y, FC_MakeScale(1,1), text, FC_GetTextEnd(text, length));
+}
+
+FC_Rect FC_DrawTextEffect(FC_Font* font, FC_Target* dest, float x, float y, FC_Effect effect, const char* text, int length)
+{
+    if(text == NULL || font == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    set_color_for_all_caches(font, effect.color);
+
+    return FC_RenderAlignN(font, dest, x, y, effect.scale, effect.alignment, text, FC_GetTextEnd(text, length));
+}
+
+
+// Text layout
+
+int FC_LayoutText(FC_Font* font, FC_TextLayout* layout, FC_Scale scale, const char* text, int length)
+{
+    const char* end;
+    const char* c;
+    FC_GlyphData glyph;
+    Uint32 codepoint;
+    float destX = 0;
+    float destY = 0;
+
+    if(layout == NULL)
+        return 0;
+
+    layout->count = 0;
+    layout->scale = scale;
+    layout->width = 0;
+    layout->height = 0;
+    if(text == NULL || font == NULL)
+        return 0;
+
+    end = FC_GetTextEnd(text, length);
+    layout->height = font->height*scale.y;
+
+    for(c = text; c < end; c++)
+    {
+        if(*c == '\n')
+        {
+            destX = 0;
+            destY += (font->height + font->lineSpacing)*scale.y;
+            layout->height = destY + font->height*scale.y;
+            continue;
+        }
+
+        codepoint = FC_GetCodepointFromUTF8(&c, 1);
+        if(!FC_GetGlyphData(font, &glyph, codepoint))
+        {
+            codepoint = ' ';
+            if(!FC_GetGlyphData(font, &glyph, codepoint))
+                continue;
+        }
+
+        if(codepoint != ' ')
+        {
+            FC_Quad* quad;
+            if(layout->count == layout->capacity)
+            {
+                int new_capacity = (layout->capacity > 0? layout->capacity*2 : 32);
+                FC_Quad* new_quads = (FC_Quad*)realloc(layout->quads, new_capacity * sizeof(FC_Quad));
+                if(new_quads == NULL)
+                    break;
+                layout->quads = new_quads;
+                layout->capacity = new_capacity;
+            }
+
+            quad = &layout->quads[layout->count++];
+            #ifdef FC_USE_SDL_GPU
+            quad->src.x = glyph.rect.x;
+            quad->src.y = glyph.rect.y;
+            quad->src.w = glyph.rect.w;
+            quad->src.h = glyph.rect.h;
+            #else
+            quad->src = glyph.rect;
+            #endif
+            quad->x = destX;
+            quad->y = destY;
+            quad->cache_level = glyph.cache_level;
+        }
+
+        destX += glyph.rect.w*scale.x + font->letterSpacing*scale.x;
+        if(destX > layout->width)
+            layout->width = destX;
+    }
+
+    return layout->count;
+}
+
+static FC_Rect FC_RenderLayout(FC_Font* font, FC_Target* dest, float x, float y, const FC_TextLayout* layout)
+{
+    FC_Rect dirtyRect = FC_MakeRect(x, y, 0, 0);
+    FC_Rect srcRect;
+    FC_Rect dstRect;
+    int i;
+
+    if(layout == NULL || dest == NULL || font->glyph_cache_count == 0)
+        return dirtyRect;
+
+    for(i = 0; i < layout->count; ++i)
+    {
+        const FC_Quad* quad = &layout->quads[i];
+        srcRect = quad->src;
+        dstRect = fc_render_callback(FC_GetGlyphCacheLevel(font, quad->cache_level), &srcRect, dest, x + quad->x, y + quad->y, layout->scale.x, layout->scale.y);
+        if(dirtyRect.w == 0 || dirtyRect.h == 0)
+            dirtyRect = dstRect;
+        else
+            dirtyRect = FC_RectUnion(dirtyRect, dstRect);
+    }
+
+    return dirtyRect;
+}
+
+FC_Rect FC_DrawLayout(FC_Font* font, FC_Target* dest, float x, float y, const FC_TextLayout* layout)
+{
+    if(font == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    set_color_for_all_caches(font, font->default_color);
+
+    return FC_RenderLayout(font, dest, x, y, layout);
+}
+
+FC_Rect FC_DrawLayoutColor(FC_Font* font, FC_Target* dest, float x, float y, SDL_Color color, const FC_TextLayout* layout)
+{
+    if(font == NULL)
+        return FC_MakeRect(x, y, 0, 0);
+
+    set_color_for_all_caches(font, color);
+
+    return FC_RenderLayout(font, dest, x, y, layout);
+}
+
+void FC_FreeLayout(FC_TextLayout* layout)
+{
+    if(layout == NULL)
+        return;
+
+    free(layout->quads);
+    layout->quads = NULL;
+    layout->count = 0;
+    layout->capacity = 0;
+}
+
 typedef struct FC_StringList
 {
     char* value;
@@ -2391,10 +2789,29 @@ Uint16 FC_GetHeight(FC_Font* font, const char* formatted_text, ...)
 
     FC_EXTRACT_VARARGS(fc_buffer, formatted_text);
 
+    return FC_GetTextHeight(font, fc_buffer, -1);
+}
+
+Uint16 FC_GetWidth(FC_Font* font, const char* formatted_text, ...)
+{
+    if(formatted_text == NULL || font == NULL)
+        return 0;
+
+    FC_EXTRACT_VARARGS(fc_buffer, formatted_text);
+
+    return FC_GetTextWidth(font, fc_buffer, -1);
+}
+
+Uint16 FC_GetTextHeight(FC_Font* font, const char* text, int length)
+{
+    if(text == NULL || font == NULL)
+        return 0;
+
+    const char* end = FC_GetTextEnd(text, length);
     Uint16 numLines = 1;
     const char* c;
 
-    for (c = fc_buffer; *c != '\0'; c++)
+    for (c = text; c < end; c++)
     {
         if(*c == '\n')
             numLines++;
@@ -2404,18 +2821,17 @@ Uint16 FC_GetHeight(FC_Font* font, const char* formatted_text, ...)
     return font->height*numLines + font->lineSpacing*(numLines - 1);  //height*numLines;
 }
 
-Uint16 FC_GetWidth(FC_Font* font, const char* formatted_text, ...)
+Uint16 FC_GetTextWidth(FC_Font* font, const char* text, int length)
 {
-    if(formatted_text == NULL || font == NULL)
+    if(text == NULL || font == NULL)
         return 0;
 
-    FC_EXTRACT_VARARGS(fc_buffer, formatted_text);
-
+    const char* end = FC_GetTextEnd(text, length);
     const char* c;
     Uint16 width = 0;
     Uint16 bigWidth = 0;  // Allows for multi-line strings
 
-    for (c = fc_buffer; *c != '\0'; c++)
+    for (c = text; c < end; c++)
     {
         if(*c == '\n')
         {
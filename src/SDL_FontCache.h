@@ -108,6 +108,28 @@ typedef struct FC_GlyphData
 
 } FC_GlyphData;
 
+// A single glyph placed by FC_LayoutText, relative to the draw position
+typedef struct FC_Quad
+{
+    FC_Rect src;
+    float x;
+    float y;
+    int cache_level;
+
+} FC_Quad;
+
+// Reusable array of laid out glyphs.  Zero-initialize before first use and release with FC_FreeLayout().
+typedef struct FC_TextLayout
+{
+    FC_Quad* quads;
+    int count;
+    int capacity;
+    FC_Scale scale;
+    float width;
+    float height;
+
+} FC_TextLayout;
+
 
 
 
@@ -143,6 +165,27 @@ Uint8 FC_LoadFontFromTTF(FC_Font* font, SDL_Renderer* renderer, TTF_Font* ttf, S
 Uint8 FC_LoadFont_RW(FC_Font* font, SDL_Renderer* renderer, SDL_RWops* file_rwops_ttf, Uint8 own_rwops, Uint32 pointSize, SDL_Color color, int style);
 #endif
 
+
+// Baked fonts
+// An offline tool rasterizes the loading string with FC_BakeFontSurfaces() and saves the surfaces along with
+// FC_GetBakedMetrics().  The game then uploads them with FC_LoadFontFromBaked() without touching the TTF.
+
+/*! Rasterizes the loading string into new surfaces without needing a renderer.  Returns the number of surfaces (cache levels) written. */
+int FC_BakeFontSurfaces(FC_Font* font, TTF_Font* ttf, SDL_Surface** surfaces, int max_surfaces);
+
+/*! Returns a malloc'd text description of the font's metrics and glyph rects.  Free it with free(). */
+char* FC_GetBakedMetrics(FC_Font* font);
+
+/*! Loads the font from baked cache level surfaces and metrics text.  The surfaces are not freed. */
+#ifdef FC_USE_SDL_GPU
+Uint8 FC_LoadFontFromBaked(FC_Font* font, SDL_Surface** cache_levels, int num_levels, const char* metrics, SDL_Color color);
+#else
+Uint8 FC_LoadFontFromBaked(FC_Font* font, SDL_Renderer* renderer, SDL_Surface** cache_levels, int num_levels, const char* metrics, SDL_Color color);
+#endif
+
+/*! Sets the TTF that a baked font opens the first time it needs a glyph that was not baked.  Call it after loading. */
+void FC_SetFallbackFont(FC_Font* font, const char* filename_ttf, Uint32 pointSize, int style);
+
 #ifndef FC_USE_SDL_GPU
 // note: handle SDL event types SDL_RENDER_TARGETS_RESET(>= SDL 2.0.2) and SDL_RENDER_DEVICE_RESET(>= SDL 2.0.4)
 void FC_ResetFontFromRendererReset(FC_Font* font, SDL_Renderer* renderer, Uint32 evType);
@@ -275,6 +318,26 @@ FC_Rect FC_DrawColumnScale(FC_Font* font, FC_Target* dest, float x, float y, Uin
 FC_Rect FC_DrawColumnColor(FC_Font* font, FC_Target* dest, float x, float y, Uint16 width, SDL_Color color, const char* formatted_text, ...);
 FC_Rect FC_DrawColumnEffect(FC_Font* font, FC_Target* dest, float x, float y, Uint16 width, FC_Effect effect, const char* formatted_text, ...);
 
+// Unformatted rendering
+// These take the text as-is (no printf formatting) with its length in bytes, or -1 if it is NULL-terminated.
+
+FC_Rect FC_DrawText(FC_Font* font, FC_Target* dest, float x, float y, const char* text, int length);
+FC_Rect FC_DrawTextColor(FC_Font* font, FC_Target* dest, float x, float y, SDL_Color color, const char* text, int length);
+FC_Rect FC_DrawTextEffect(FC_Font* font, FC_Target* dest, float x, float y, FC_Effect effect, const char* text, int length);
+
+Uint16 FC_GetTextHeight(FC_Font* font, const char* text, int length);
+Uint16 FC_GetTextWidth(FC_Font* font, const char* text, int length);
+
+
+// Text layout
+
+/*! Lays the text out into layout->quads, only reallocating when the array is too small.  Returns the number of quads.
+    The layout refers to the font's glyph cache, so it has to be redone after FC_ResetFontFromRendererReset(). */
+int FC_LayoutText(FC_Font* font, FC_TextLayout* layout, FC_Scale scale, const char* text, int length);
+FC_Rect FC_DrawLayout(FC_Font* font, FC_Target* dest, float x, float y, const FC_TextLayout* layout);
+FC_Rect FC_DrawLayoutColor(FC_Font* font, FC_Target* dest, float x, float y, SDL_Color color, const FC_TextLayout* layout);
+void FC_FreeLayout(FC_TextLayout* layout);
+
 
 // Getters
 
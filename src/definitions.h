@@ -3,11 +3,18 @@
 #include <functional>
 #include <stdint.h>
 #include <array>
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
 #include <cmath>
 #include <algorithm>
 #include <memory>
 #include <random>
 #include "SDL_FontCache.h"
+#include "level_palette.h"
+#include "level_arena.h"
+#include "function_ref.h"
 
 // The logical screen width and height being rendered to
 #define SCREEN_WIDTH 3840
@@ -40,6 +47,9 @@
 #define LogWarn(...) SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__);
 #define LogError(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__);
 
+// Logs through the macros above
+#include "frame_arena.h"
+
 #define MUL_UP_1L 1.005f
 #define MUL_UP_2L 1.01f
 #define MUL_DOWN_1L 0.995025f
@@ -68,39 +78,6 @@ using uint64 = uint64_t;
 using real32 = float;
 using real64 = double;
 
-Uint32 getPixel(SDL_Surface* surface, int x, int y)
-{
-	int bpp = surface->format->BytesPerPixel;
-	/* Here p is the address to the pixel we want to retrieve */
-	Uint8* p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
-
-	switch (bpp)
-	{
-	case 1:
-		return *p;
-		break;
-
-	case 2:
-		return *(Uint16*)p;
-		break;
-
-	case 3:
-		if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
-			return p[0] << 16 | p[1] << 8 | p[2];
-		else
-			return p[0] | p[1] << 8 | p[2] << 16;
-		break;
-
-	case 4:
-		return *(Uint32*)p;
-		break;
-
-	default:
-		return 0; /* shouldn't happen, but avoids warnings */
-	}
-}
-
-
 struct Vector2f
 {
 	real32 x;
@@ -353,6 +330,100 @@ Vector2f rotatePoint(const Vector2f& point, const Vector2f& pivot, float angleIn
     return rotatedPoint;
 }
 
+/** Oriented rect collision */
+// Sine and cosine of an angle, computed once and reused for every point rotated by it
+struct Rotation2f
+{
+	real32 cos = 1;
+	real32 sin = 0;
+
+	static Rotation2f fromDegrees(real32 angleInDegrees)
+	{
+		const real32 angleInRadians = angleInDegrees * (real32)M_PI / 180.0f;
+		return {cosf(angleInRadians), sinf(angleInRadians)};
+	}
+
+	inline Vector2f rotate(Vector2f v) const
+	{
+		return {v.x * cos - v.y * sin, v.x * sin + v.y * cos};
+	}
+};
+
+struct OrientedRect2f
+{
+	Vector2f center;
+	Vector2f halfSize;
+	// Unit axes of the rect's local x and y
+	Vector2f axisX = {1, 0};
+	Vector2f axisY = {0, 1};
+
+	/// rect rotated around pivot, both in the same space
+	static OrientedRect2f fromRotatedRect(const Rect2f& rect, Vector2f pivot, const Rotation2f& rotation)
+	{
+		OrientedRect2f result;
+		result.center = pivot + rotation.rotate(rect.getCenter() - pivot);
+		result.halfSize = {rect.w / 2, rect.h / 2};
+		result.axisX = rotation.rotate({1, 0});
+		result.axisY = rotation.rotate({0, 1});
+		return result;
+	}
+
+	/// Clockwise starting from the local top left
+	void getCorners(Vector2f corners[4]) const
+	{
+		const Vector2f ex = axisX * halfSize.x;
+		const Vector2f ey = axisY * halfSize.y;
+		corners[0] = center - ex - ey;
+		corners[1] = center + ex - ey;
+		corners[2] = center + ex + ey;
+		corners[3] = center - ex + ey;
+	}
+
+	inline real32 getProjectedRadius(Vector2f axis) const
+	{
+		return halfSize.x * fabsf(dot(axisX, axis)) + halfSize.y * fabsf(dot(axisY, axis));
+	}
+
+	/// Separating axis test, touching edges do not count like in Rect2f::collides
+	bool collides(const Rect2f& rect) const
+	{
+		const Vector2f rectHalfSize = {rect.w / 2, rect.h / 2};
+		const Vector2f offset = rect.getCenter() - center;
+		// World axes, where the rect's projection is just its half size
+		if (fabsf(offset.x) >= rectHalfSize.x + getProjectedRadius({1, 0}) ||
+			fabsf(offset.y) >= rectHalfSize.y + getProjectedRadius({0, 1}))
+		{
+			return false;
+		}
+		// Own axes, where this rect's projection is its half size
+		for (int32 i = 0; i < 2; ++i)
+		{
+			const Vector2f axis = i == 0 ? axisX : axisY;
+			const real32 radius = i == 0 ? halfSize.x : halfSize.y;
+			const real32 rectRadius = rectHalfSize.x * fabsf(axis.x) + rectHalfSize.y * fabsf(axis.y);
+			if (fabsf(dot(offset, axis)) >= radius + rectRadius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool collides(const OrientedRect2f& other) const
+	{
+		const Vector2f offset = other.center - center;
+		const Vector2f axes[] = {axisX, axisY, other.axisX, other.axisY};
+		for (const Vector2f& axis : axes)
+		{
+			if (fabsf(dot(offset, axis)) >= getProjectedRadius(axis) + other.getProjectedRadius(axis))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
 /** Rect - line collision */
 inline bool isPointInAABB(const Vector2f& p, const Rect2f& rect) {
 	return (p.x >= rect.x && p.x <= rect.x + rect.w && p.y >= rect.y && p.y <= rect.y + rect.h);
@@ -417,20 +488,247 @@ bool checkAABBLineCollision(const Vector2f& p1, const Vector2f& p2, const Rect2f
 }
 
 void renderOutlinedText(FC_Font* font, SDL_Renderer* renderer, float x, float y, const char* text, int outlineWidth=3, SDL_Color textColor = {255, 255, 255, 255}, SDL_Color outlineColor = {0, 0, 0, 255}) {
-    FC_SetDefaultColor(font, outlineColor);
+    // Lay the glyphs out once and reuse them for every outline offset
+    static FC_TextLayout layout = {};
+    FC_LayoutText(font, &layout, FC_MakeScale(1, 1), text, -1);
 
     for (int dx = -outlineWidth; dx <= outlineWidth; ++dx) {
         for (int dy = -outlineWidth; dy <= outlineWidth; ++dy) {
             if (dx != 0 || dy != 0) {
-                FC_Draw(font, renderer, x + dx, y + dy, text);
+                FC_DrawLayoutColor(font, renderer, x + dx, y + dy, outlineColor, &layout);
             }
         }
     }
 
     FC_SetDefaultColor(font, textColor);
-    FC_Draw(font, renderer, x, y, text);
+    FC_DrawLayout(font, renderer, x, y, &layout);
 }
 
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache
+{
+public:
+	explicit LruCache(size_t capacity) : capacity(capacity)
+	{
+	}
+
+	/// Returns the cached value and marks it as most recently used
+	Value* find(const Key& key)
+	{
+		auto it = index.find(key);
+		if (it == index.end())
+		{
+			return nullptr;
+		}
+		entries.splice(entries.begin(), entries, it->second);
+		return &it->second->second;
+	}
+
+	/// Inserts a value, handing the least recently used one to onEvict if the cache is full
+	template <typename OnEvict>
+	Value& insert(const Key& key, Value value, OnEvict onEvict)
+	{
+		if (entries.size() >= capacity)
+		{
+			onEvict(entries.back().second);
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+		entries.emplace_front(key, std::move(value));
+		index[entries.front().first] = entries.begin();
+		return entries.front().second;
+	}
+
+	template <typename OnEvict>
+	void clear(OnEvict onEvict)
+	{
+		for (auto& entry : entries)
+		{
+			onEvict(entry.second);
+		}
+		entries.clear();
+		index.clear();
+	}
+
+	inline size_t size() const
+	{
+		return entries.size();
+	}
+
+private:
+	size_t capacity;
+	std::list<std::pair<Key, Value>> entries;
+	std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index;
+};
+
+struct TextKey
+{
+	FC_Font* font = nullptr;
+	std::string text;
+	SDL_Color textColor = {};
+	SDL_Color outlineColor = {};
+	int32 outlineWidth = 0;
+
+	bool operator==(const TextKey& b) const
+	{
+		return font == b.font && outlineWidth == b.outlineWidth && text == b.text &&
+			memcmp(&textColor, &b.textColor, sizeof(SDL_Color)) == 0 && memcmp(&outlineColor, &b.outlineColor, sizeof(SDL_Color)) == 0;
+	}
+};
+
+struct TextKeyHash
+{
+	std::size_t operator()(const TextKey& key) const noexcept
+	{
+		uint32 colors[2];
+		memcpy(&colors[0], &key.textColor, sizeof(uint32));
+		memcpy(&colors[1], &key.outlineColor, sizeof(uint32));
+		std::size_t h = std::hash<std::string>()(key.text);
+		h ^= std::hash<const void*>()(key.font) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		h ^= std::hash<uint64>()(((uint64)colors[0] << 32) | colors[1]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h ^ (std::size_t)key.outlineWidth;
+	}
+};
+
+struct TextCacheEntry
+{
+	SDL_Texture* texture = nullptr;
+	// Size of the texture, including the outline margin on every side
+	int32 width = 0;
+	int32 height = 0;
+	int32 margin = 0;
+};
+
+/// Renders each (font, string, colors, outline) combination once into a texture so static
+/// UI strings become a single blit instead of up to (2w+1)^2 FC_Draw calls per frame.
+/// Text metrics are cached as well.
+class TextCache
+{
+public:
+	TextCache(size_t capacity = 64, size_t metricsCapacity = 256) : entries(capacity), metrics(metricsCapacity)
+	{
+	}
+
+	SDL_Point measure(FC_Font* font, const char* text)
+	{
+		metricsKey.font = font;
+		metricsKey.text = text;
+		if (SDL_Point* size = metrics.find(metricsKey))
+		{
+			return *size;
+		}
+		const SDL_Point size = {FC_GetTextWidth(font, text, -1), FC_GetTextHeight(font, text, -1)};
+		return metrics.insert(metricsKey, size, [](SDL_Point&) {});
+	}
+
+	void draw(FC_Font* font, SDL_Renderer* renderer, float x, float y, const char* text, int32 outlineWidth, SDL_Color textColor, SDL_Color outlineColor = {0, 0, 0, 255})
+	{
+		const TextCacheEntry* entry = get(font, renderer, text, outlineWidth, textColor, outlineColor);
+		if (!entry)
+		{
+			// No render target support, draw it the slow way
+			if (outlineWidth > 0)
+			{
+				renderOutlinedText(font, renderer, x, y, text, outlineWidth, textColor, outlineColor);
+			}
+			else
+			{
+				FC_DrawTextColor(font, renderer, x, y, textColor, text, -1);
+			}
+			return;
+		}
+		const SDL_FRect dest = {x - entry->margin, y - entry->margin, (real32)entry->width, (real32)entry->height};
+		SDL_RenderCopyF(renderer, entry->texture, NULL, &dest);
+	}
+
+	inline void draw(FC_Font* font, SDL_Renderer* renderer, float x, float y, const char* text)
+	{
+		draw(font, renderer, x, y, text, 0, FC_GetDefaultColor(font));
+	}
+
+	/// Textures have to be rebuilt after the renderer loses its targets
+	void clear()
+	{
+		entries.clear([](TextCacheEntry& entry) { SDL_DestroyTexture(entry.texture); });
+	}
+
+private:
+	const TextCacheEntry* get(FC_Font* font, SDL_Renderer* renderer, const char* text, int32 outlineWidth, SDL_Color textColor, SDL_Color outlineColor)
+	{
+		lookupKey.font = font;
+		lookupKey.text = text;
+		lookupKey.textColor = textColor;
+		lookupKey.outlineColor = outlineColor;
+		lookupKey.outlineWidth = outlineWidth;
+		if (TextCacheEntry* entry = entries.find(lookupKey))
+		{
+			return entry;
+		}
+		if (!SDL_RenderTargetSupported(renderer))
+		{
+			return nullptr;
+		}
+
+		// A couple of extra pixels in case glyphs overhang the measured size
+		const SDL_Point size = measure(font, text);
+		TextCacheEntry entry;
+		entry.margin = outlineWidth + 2;
+		entry.width = size.x + 2 * entry.margin;
+		entry.height = size.y + 2 * entry.margin;
+		entry.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, entry.width, entry.height);
+		if (!entry.texture)
+		{
+			LogWarn("Could not create text texture: %s", SDL_GetError());
+			return nullptr;
+		}
+
+		// The texture ends up with premultiplied alpha, so it is blitted with a matching blend mode
+		const SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+		                                                               SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+		if (SDL_SetTextureBlendMode(entry.texture, premultiplied) != 0)
+		{
+			SDL_SetTextureBlendMode(entry.texture, SDL_BLENDMODE_BLEND);
+		}
+
+		SDL_Texture* oldTarget = SDL_GetRenderTarget(renderer);
+		SDL_FPoint oldScale;
+		SDL_RenderGetScale(renderer, &oldScale.x, &oldScale.y);
+		SDL_Color oldDrawColor;
+		SDL_GetRenderDrawColor(renderer, &oldDrawColor.r, &oldDrawColor.g, &oldDrawColor.b, &oldDrawColor.a);
+		const SDL_Color oldFontColor = FC_GetDefaultColor(font);
+
+		SDL_SetRenderTarget(renderer, entry.texture);
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+		SDL_RenderClear(renderer);
+		if (outlineWidth > 0)
+		{
+			renderOutlinedText(font, renderer, entry.margin, entry.margin, text, outlineWidth, textColor, outlineColor);
+		}
+		else
+		{
+			FC_DrawTextColor(font, renderer, entry.margin, entry.margin, textColor, text, -1);
+		}
+		SDL_SetRenderTarget(renderer, oldTarget);
+		if (oldTarget)
+		{
+			// Switching targets resets the scale, which the scaled scene target relies on
+			SDL_RenderSetScale(renderer, oldScale.x, oldScale.y);
+		}
+		SDL_SetRenderDrawColor(renderer, oldDrawColor.r, oldDrawColor.g, oldDrawColor.b, oldDrawColor.a);
+		FC_SetDefaultColor(font, oldFontColor);
+
+		return &entries.insert(lookupKey, entry, [](TextCacheEntry& evicted) { SDL_DestroyTexture(evicted.texture); });
+	}
+
+	LruCache<TextKey, TextCacheEntry, TextKeyHash> entries;
+	LruCache<TextKey, SDL_Point, TextKeyHash> metrics;
+	// Reused for lookups so a cache hit does not allocate
+	TextKey lookupKey;
+	TextKey metricsKey;
+};
+
+TextCache text_cache;
+
 template <typename T>
 bool deleteFromVector(std::vector<T>& vec, const T& valueToRemove) {
     auto it = std::find(vec.begin(), vec.end(), valueToRemove);
@@ -441,10 +739,10 @@ bool deleteFromVector(std::vector<T>& vec, const T& valueToRemove) {
 	return false;
 }
 
-template <typename T>
-bool deleteUniqueFromVector(std::vector<std::unique_ptr<T>>& vec, const T* valueToRemove) {
+template <typename T, typename Deleter>
+bool deleteUniqueFromVector(std::vector<std::unique_ptr<T, Deleter>>& vec, const T* valueToRemove) {
     auto it = std::find_if(vec.begin(), vec.end(),
-            [valueToRemove](const std::unique_ptr<T>& value) {
+            [valueToRemove](const std::unique_ptr<T, Deleter>& value) {
                 return value.get() == valueToRemove;
             });
     if (it != vec.end()) {
@@ -525,16 +823,6 @@ SDL_Texture* enemy_boss_texture_main_crouched = NULL;
 SDL_Texture* enemy_boss_texture_smallclaw_normal = NULL;
 SDL_Texture* enemy_boss_texture_spit = NULL;
 
-SDL_Texture* decor_texture_seaweed = NULL;
-SDL_Texture* decor_texture_coral1 = NULL;
-SDL_Texture* decor_texture_coral2 = NULL;
-SDL_Texture* decor_texture_rock1 = NULL;
-SDL_Texture* decor_texture_rock2 = NULL;
-SDL_Texture* decor_texture_rock3 = NULL;
-SDL_Texture* decor_texture_arrow_up = NULL;
-SDL_Texture* decor_texture_arrow_up_right = NULL;
-SDL_Texture* decor_texture_arrow_down_right = NULL;
-
 SDL_Texture* diagonal_texture = NULL;
 SDL_Texture* key_texture = NULL;
 SDL_Texture* door_texture = NULL;
@@ -556,10 +844,9 @@ SDL_Texture* heart_texture = NULL;
 SDL_Texture* grampa_texture = NULL;
 SDL_Texture* stun_texture = NULL;
 
-Mix_Music* title_music = NULL;
-Mix_Music* level_music = NULL;
-Mix_Music* boss_music = NULL;
-Mix_Music* winscreen_music = NULL;
+SDL_Texture* particle_texture_bubble1 = NULL;
+SDL_Texture* particle_texture_bubble2 = NULL;
+SDL_Texture* particle_texture_bubble3 = NULL;
 
 Mix_Chunk* shoot = NULL;
 Mix_Chunk* popHurt = NULL;
@@ -581,6 +868,10 @@ Mix_Chunk* boss_hurt = NULL;
 void renderTexture(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_FRect* destRect);
 void renderTextureEx(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_FRect* destRect, const double angle, const SDL_FPoint* center, SDL_RendererFlip flip);
 void changeCurrentState(State new_state);
+// Particle effects, see particles.h
+void emitBlockDebris(const Rect2f& block, Vector2f velocity);
+void emitBubblePop(Vector2f center, real32 radius);
+void clearParticles();
 
 enum Direction
 {
@@ -602,7 +893,7 @@ public:
 	}
 
 	void move(real32 x, real32 y);
-	std::vector<Actor*> getAllRidingActors();
+	FrameVector<Actor*> getAllRidingActors(const FrameVector<uint32>& nearby);
 	bool overlapCheck(Actor* actor);
 
 	real32 getLeft() const
@@ -630,6 +921,10 @@ public:
 		return Vector2f(position.x + width/2, position.y + height/2);
 	}
 
+	inline Rect2f getRect() const
+	{
+		return {position.x, position.y, width, height};
+	}
 
 	inline void render(SDL_Renderer* renderer)
 	{
@@ -672,23 +967,186 @@ public:
 	SDL_FRect dest_rect;
 	bool doesMove = false;
 	bool breakable = false;
+	// Broken tiles stay in Level::solids so the broadphase indices remain valid
+	bool broken = false;
 	SDL_Texture* texture = nullptr;
 };
 
-struct ActorTexture {
+enum class TextureType {
+	Idle, Swim, Puffing, Count
+};
+
+enum class AnimationLoop : uint8 {
+	Loop, Once
+};
+
+/// Frame rects and timing of a horizontal sprite strip. Clips are immutable once built
+/// and shared by every actor that plays the same strip, see AnimationLibrary.
+struct AnimationClip
+{
 	SDL_Texture* texture = nullptr;
-	SDL_Point size = {};
+	std::vector<SDL_Rect> frames;
+	std::vector<real32> frameDurations;
+	std::vector<real32> frameEnds;
+	AnimationLoop loop = AnimationLoop::Loop;
+
+	inline uint32 getFrameCount() const
+	{
+		return (uint32)frames.size();
+	}
+
+	inline real32 getDuration() const
+	{
+		return frameEnds.back();
+	}
+
+	/// Frame shown after playing for the given time, for clips driven by an external clock
+	uint32 getFrameAt(real32 time) const
+	{
+		if (loop == AnimationLoop::Loop)
+		{
+			time = fmodf(time, getDuration());
+		}
+		const auto it = std::upper_bound(frameEnds.begin(), frameEnds.end(), time);
+		return it == frameEnds.end() ? getFrameCount() - 1 : (uint32)(it - frameEnds.begin());
+	}
 };
 
-enum class TextureType {
-	Idle, Swim, Puffing
+struct AnimationClipKey
+{
+	SDL_Texture* texture;
+	int32 frameWidth;
+	int32 frameHeight;
+	real32 frameDuration;
+	real32 firstFrameDuration;
+	AnimationLoop loop;
+
+	bool operator==(const AnimationClipKey& other) const
+	{
+		return texture == other.texture && frameWidth == other.frameWidth && frameHeight == other.frameHeight &&
+			frameDuration == other.frameDuration && firstFrameDuration == other.firstFrameDuration && loop == other.loop;
+	}
+};
+
+struct AnimationClipKeyHash
+{
+	size_t operator()(const AnimationClipKey& key) const
+	{
+		size_t h = std::hash<SDL_Texture*>()(key.texture);
+		h ^= std::hash<int32>()(key.frameWidth) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		h ^= std::hash<int32>()(key.frameHeight) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		h ^= std::hash<real32>()(key.frameDuration) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h;
+	}
+};
+
+/// Owns every clip. Lookups only happen when an actor changes its textures, never per frame.
+class AnimationLibrary
+{
+public:
+	/// Returns the clip of the texture cut into frameWidth x frameHeight frames, building it on first use.
+	/// firstFrameDuration overrides how long the first frame is held, 0 means frameDuration.
+	const AnimationClip* get(SDL_Texture* texture, int32 frameWidth, int32 frameHeight, real32 frameDuration, real32 firstFrameDuration = 0, AnimationLoop loop = AnimationLoop::Loop)
+	{
+		const AnimationClipKey key = {texture, frameWidth, frameHeight, frameDuration, firstFrameDuration, loop};
+		auto it = clips.find(key);
+		if (it != clips.end())
+		{
+			return it->second.get();
+		}
+
+		auto clip = std::make_unique<AnimationClip>();
+		clip->texture = texture;
+		clip->loop = loop;
+		SDL_Point size = {0, 0};
+		SDL_QueryTexture(texture, NULL, NULL, &size.x, &size.y);
+		const uint32 frameCount = MAX(1, frameWidth > 0 ? size.x / frameWidth : 1);
+		real32 end = 0;
+		for (uint32 i = 0; i < frameCount; i++)
+		{
+			const real32 duration = (i == 0 && firstFrameDuration > 0) ? firstFrameDuration : frameDuration;
+			end += duration;
+			clip->frames.push_back({(int)(i * frameWidth), 0, frameWidth, frameHeight});
+			clip->frameDurations.push_back(duration);
+			clip->frameEnds.push_back(end);
+		}
+		return clips.emplace(key, std::move(clip)).first->second.get();
+	}
+
+	void clear()
+	{
+		clips.clear();
+	}
+
+private:
+	std::unordered_map<AnimationClipKey, std::unique_ptr<AnimationClip>, AnimationClipKeyHash> clips;
+};
+
+AnimationLibrary animation_library;
+
+/// Per-actor playback position in a shared clip
+struct AnimationCursor
+{
+	const AnimationClip* clip = nullptr;
+	uint32 frame = 0;
+	real32 lastStepTime = 0;
+
+	/// Switches clips but keeps the frame index, like swapping between idle and swim strips
+	inline void setClip(const AnimationClip* newClip)
+	{
+		clip = newClip;
+		if (frame >= clip->getFrameCount())
+		{
+			frame %= clip->getFrameCount();
+		}
+	}
+
+	inline void restart(const AnimationClip* newClip, real32 now)
+	{
+		clip = newClip;
+		frame = 0;
+		lastStepTime = now;
+	}
+
+	/// Advances at most one frame once the current one has been held long enough
+	inline void step(real32 now)
+	{
+		if (now - lastStepTime > clip->frameDurations[frame])
+		{
+			lastStepTime = now;
+			if (frame + 1 < clip->getFrameCount())
+			{
+				frame++;
+			}
+			else if (clip->loop == AnimationLoop::Loop)
+			{
+				frame = 0;
+			}
+		}
+	}
+
+	inline SDL_Texture* getTexture() const
+	{
+		return clip->texture;
+	}
+
+	inline const SDL_Rect* getRect() const
+	{
+		return &clip->frames[frame];
+	}
 };
 
+// Collision response of Actor::moveX and moveY, called from the per pixel step loop
+using CollisionCallback = FunctionRef<void()>;
+
 class Actor
 {
 public:
-	virtual void moveX(real32 amount, std::function<void()> on_collide = nullptr);
-	virtual void moveY(real32 amount, std::function<void()> on_collide = nullptr);
+	// Enemies and the other level actors are destroyed through base pointers
+	virtual ~Actor() = default;
+	// on_collide runs when a step is blocked, it is only referenced for the duration of the call
+	virtual void moveX(real32 amount, CollisionCallback on_collide = nullptr);
+	virtual void moveY(real32 amount, CollisionCallback on_collide = nullptr);
 	virtual void update(real32 time_delta, const ControllerInput* input);
 	virtual void hurt(Actor* hurter, int32 damage=1);
 	virtual void die();
@@ -700,12 +1158,10 @@ public:
 	real32 width = 0;
 	real32 height = 0;
 	Rect2f hitRect = {0, 0, 0, 0};
-	std::unordered_map<TextureType, ActorTexture> textures;
+	std::array<const AnimationClip*, (size_t)TextureType::Count> clips = {};
+	AnimationCursor animation;
 	bool visible = true;
 	Direction facing = Direction::Right;
-	uint32 currentFrame = 0;
-	ActorTexture* currentTexture = nullptr;
-	real32 lastAnimationTime = 0;
 	real32 lastSwimSoundTime = 0;
 	real32 angle = 0;
 	bool isPlayer = false;
@@ -719,6 +1175,12 @@ public:
 	bool isDead = false;
 	bool diesOnImpact = false;
 	bool noClip = false;
+	// Pushed and carried by moving solids
+	bool carriedBySolids = false;
+	// Level chunk the actor was spawned with, -1 for actors that are not streamed
+	int32 streamChunk = -1;
+	// Index of its spawner in the level, streamed actors are kept in this order
+	int32 streamSpawner = -1;
 	real32 movingAnimationDelay = 0.1f;
 	real32 idleAnimationDelay = 0.8f;
 	int32 puffingFrames = 0;
@@ -746,14 +1208,15 @@ public:
 	{
 		if (visible)
 		{
-			const SDL_Rect sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
 			const SDL_FRect rect = {position.x, position.y, width, height};
 			SDL_FPoint center(width/2, height/2);
-			renderTextureEx(renderer, currentTexture->texture, &sprite_rect, &rect, angle, &center, facing == Right ? SDL_FLIP_NONE : SDL_FLIP_HORIZONTAL);
+			renderTextureEx(renderer, animation.getTexture(), animation.getRect(), &rect, angle, &center, facing == Right ? SDL_FLIP_NONE : SDL_FLIP_HORIZONTAL);
 		}
 	}
 
-	const Solid* collideAt(const std::vector<Solid>& solids, Vector2f position) const;
+	const Solid* collideAt(const Level* level, Vector2f position) const;
+	void onSlopeContact(Vector2f normal);
+	bool pushOutOfShapes();
 	
 	inline real32 getLeft() const
 	{
@@ -785,16 +1248,28 @@ public:
 		return actor->visible && this->visible && getHitbox().collides(actor->getHitbox());
 	}
 
-	void setTexture(SDL_Texture* texture, TextureType type)
+	/// Cuts the texture into frames of the actor's current size
+	void setTexture(SDL_Texture* texture, TextureType type, real32 firstFrameDelay = 0)
+	{
+		const AnimationClip* clip = clips[(size_t)type];
+		if (!clip || clip->texture != texture || clip->frames[0].w != (int32)width || clip->frames[0].h != (int32)height) {
+			const real32 delay = type == TextureType::Swim ? movingAnimationDelay : idleAnimationDelay;
+			clip = animation_library.get(texture, (int32)width, (int32)height, delay, firstFrameDelay);
+		}
+		setClip(clip, type);
+	}
+
+	void setClip(const AnimationClip* clip, TextureType type)
 	{
-		ActorTexture actorTexture;
-		actorTexture.texture = texture;
-		SDL_QueryTexture(texture, NULL, NULL, &actorTexture.size.x, &actorTexture.size.y);
-		this->textures[type] = actorTexture;
+		const AnimationClip* previous = clips[(size_t)type];
+		clips[(size_t)type] = clip;
 
 		if (type == TextureType::Idle) {
-			this->currentTexture = &this->textures[type];
-			this->currentFrame = 0;
+			animation.clip = clip;
+			animation.frame = 0;
+		}
+		else if (previous && animation.clip == previous) {
+			animation.setClip(clip);
 		}
 	}
 };
@@ -805,11 +1280,13 @@ public:
 	Player()
 	{
 		isPlayer = true;
+		carriedBySolids = true;
 		width = normalSize.x;
 		height = normalSize.y;
 		maxHealth = 3;
 		health = 3;
-		this->setTexture(player_texture_puffing, TextureType::Puffing);
+		// Only played while puffed up
+		this->setClip(animation_library.get(player_texture_puffing, puffedSize.x, puffedSize.y, idleAnimationDelay), TextureType::Puffing);
 		
 		// acc_const = 700.f * 6.f;
 		accConst = 600.f * 6.f;
@@ -830,7 +1307,7 @@ public:
 		hitRect = hitRects[2];
 		setTexture(player_texture_puffing, TextureType::Idle);
 		setTexture(player_texture_puffing, TextureType::Swim);
-		currentFrame = 1;
+		animation.frame = 1;
 		playSound(deflate_sound);
 		resetPuffCooldown();
 	}
@@ -870,13 +1347,13 @@ public:
 		
 		if (puffingFrames > 0) {
 			// Puffing
-			this->currentTexture = &this->textures[TextureType::Puffing];
+			this->animation.setClip(this->clips[(size_t)TextureType::Puffing]);
 			switch(puffingFrames) {
 				case 2:
-					this->currentFrame = 0;
+					this->animation.frame = 0;
 					break;
 				case 1:
-					this->currentFrame = 1;
+					this->animation.frame = 1;
 					break;
 			}
 
@@ -886,7 +1363,7 @@ public:
 				if (!this->tryHitRectChange({0, 0}, newHitRect)) {
 					puffingFrames = -1;
 					puffingTime = 2*puffingTimeStep;
-					this->currentFrame = 0;
+					this->animation.frame = 0;
 				}
 				else {
 					if (puffingFrames == 0) {
@@ -899,13 +1376,13 @@ public:
 		}
 		else if(puffingFrames < 0) {
 			// Unpuffing
-			this->currentTexture = &this->textures[TextureType::Puffing];
+			this->animation.setClip(this->clips[(size_t)TextureType::Puffing]);
 			switch(puffingFrames) {
 				case -2:
-					this->currentFrame = 1;
+					this->animation.frame = 1;
 					break;
 				case -1:
-					this->currentFrame = 0;
+					this->animation.frame = 0;
 					break;
 			}
 
@@ -962,7 +1439,7 @@ class Decor : public Actor
 		setTexture(texture, TextureType::Idle);
 	}
 
-	virtual void update(real32 time_delta, const ControllerInput* input) override;
+	void render(SDL_Renderer* renderer) override;
 };
 
 class Key : public Actor
@@ -1025,7 +1502,6 @@ class Button : public Actor
 		height = 60;
 		hitRect = {0, 0, width, height};
 		setStartPos(startPos);
-		sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
 		dest_rect = {position.x, position.y, width, height};
 
 		setTexture(button_unpressed_texture, TextureType::Idle);
@@ -1037,13 +1513,12 @@ class Button : public Actor
 	}
 
 	void render(SDL_Renderer* renderer) override {
-		renderTextureEx(renderer, currentTexture->texture, &sprite_rect, &dest_rect, 0, NULL, isInverted ? SDL_FLIP_VERTICAL : SDL_FLIP_NONE);
+		renderTextureEx(renderer, animation.getTexture(), animation.getRect(), &dest_rect, 0, NULL, isInverted ? SDL_FLIP_VERTICAL : SDL_FLIP_NONE);
 	}
 	virtual void update(real32 time_delta, const ControllerInput* input) override;
 
 	bool isPressed = false;
 	bool isInverted = false;
-	SDL_Rect sprite_rect;
 	SDL_FRect dest_rect;
 };
 
@@ -1118,44 +1593,36 @@ enum class DiagDir {
 	TopLeft, TopRight, BotLeft, BotRight
 };
 
+// Cells per side of the square block a diagonal covers
+constexpr int32 diagonal_cells = 8;
+
+/// Only draws the ramp, the level stores its collision as slope cells (Level::addDiagonal)
 class Diagonal : public Actor
 {
 public:
 	Diagonal(Vector2f startPos, DiagDir direction): direction(direction)
 	{
-		width = 480;
-		height = 480;
+		width = diagonal_cells * LEVEL_SCALE;
+		height = diagonal_cells * LEVEL_SCALE;
 		hitRect = {0, 0, width, height};
 
 		switch (direction)
 		{
 		case DiagDir::TopLeft:
 			flip = SDL_FLIP_NONE;
-			p1 = {startPos.x, startPos.y + height};
-			p2 = {startPos.x + width, startPos.y};
-			normal = Vector2f(1, 1).getNormalized();
 			break;
 		case DiagDir::TopRight:
 			flip = SDL_FLIP_HORIZONTAL;
-			startPos.x -= width - 60;
-			p1 = {startPos.x, startPos.y};
-			p2 = {startPos.x + width, startPos.y + height};
-			normal = Vector2f(-1, 1).getNormalized();
+			startPos.x -= width - LEVEL_SCALE;
 			break;
 		case DiagDir::BotLeft:
 			flip = SDL_FLIP_VERTICAL;
-			startPos.y -= height - 60;
-			p1 = {startPos.x, startPos.y + height};
-			p2 = {startPos.x + width, startPos.y};
-			normal = Vector2f(1, -1).getNormalized();
+			startPos.y -= height - LEVEL_SCALE;
 			break;
 		default:
 			flip = (SDL_RendererFlip)(SDL_FLIP_HORIZONTAL | SDL_FLIP_VERTICAL);
-			startPos.y -= height - 60;
-			startPos.x -= width - 60;
-			p1 = {startPos.x, startPos.y + height};
-			p2 = {startPos.x + width, startPos.y};
-			normal = Vector2f(-1, -1).getNormalized();
+			startPos.y -= height - LEVEL_SCALE;
+			startPos.x -= width - LEVEL_SCALE;
 			break;
 		}
 		position = startPos;
@@ -1166,15 +1633,11 @@ public:
 	}
 
 	void render(SDL_Renderer* renderer) override;
-	virtual void update(real32 time_delta, const ControllerInput* input) override;
 
 	DiagDir direction;
 	SDL_Rect sprite_rect;
 	SDL_FRect dest_rect;
 	SDL_RendererFlip flip;
-	Vector2f p1;
-	Vector2f p2;
-	Vector2f normal;
 };
 
 class Enemy : public Actor
@@ -1183,6 +1646,7 @@ public:
 	Enemy(Vector2f startPos, const real32 startWidth, const real32 startHeight) {
 		width = startWidth;
 		height = startHeight;
+		carriedBySolids = true;
 		startPos.x -= width/2;
 		startPos.y -= height/2;
 		
@@ -1192,18 +1656,25 @@ public:
 	Vector2f spawnPoint;
 	real64 lastIdeaTime = 0;
 	ControllerInput input;
+	// No tiles between this and the player, refreshed every frame before thinking
+	bool playerInSight = false;
+	// Index into Level::enemySpawners, -1 for enemies shot by other enemies
+	int32 spawnerIndex = -1;
 
 	virtual void think(real32 time_delta) = 0;
 	virtual void die() override;
 };
 
+// Also the size the flow field finds them a way through for
+constexpr Rect2f enemy_fish_hit_rect = {150, 42, 468, 374};
+
 class EnemyFish : public Enemy
 {
 public:
 	EnemyFish(Vector2f startPos) : Enemy(startPos, 742, 444)
 	{
 		position.x += 100;
-		hitRect = {150, 42, 468, 374};
+		hitRect = enemy_fish_hit_rect;
 		
 		accConst = 550.f * 6.f;
 		velocityLimit = 2000.f * 6.f;
@@ -1219,6 +1690,7 @@ public:
 
 	virtual void think(real32 time_delta) override;
 	void chase(Vector2f target, ControllerInput &input);
+	void chasePlayer(ControllerInput &input);
 	void render(SDL_Renderer* renderer) override;
 	virtual void update(real32 time_delta, const ControllerInput* input) override;
 };
@@ -1237,7 +1709,8 @@ public:
 		maxHealth = 1;
 		idleAnimationDelay = 0.075f;
 
-		setTexture(enemy_jellyfish_texture_idle, TextureType::Idle);
+		// Rests on the first frame between pulses
+		setTexture(enemy_jellyfish_texture_idle, TextureType::Idle, 2.5f);
 	}
 
 	real32 bobTimer = 0;
@@ -1267,27 +1740,19 @@ public:
 
 		setTexture(enemy_shrimp_texture_main, TextureType::Idle);
 		
-		textureClaw = enemy_shrimp_texture_claw;
-		SDL_QueryTexture(textureClaw, NULL, NULL, &textureClawSize.x, &textureClawSize.y);
-		textureClawAttack = enemy_shrimp_texture_claw_attack;
-		SDL_QueryTexture(textureClawAttack, NULL, NULL, &textureClawAttackSize.x, &textureClawAttackSize.y);
-		
-		currentClawTexture = textureClaw;
-		currentClawTextureSize = textureClawSize;
+		clawClip = animation_library.get(enemy_shrimp_texture_claw, (int32)width, (int32)height, clawAnimationDelay);
+		clawAttackClip = animation_library.get(enemy_shrimp_texture_claw_attack, (int32)width, (int32)height, clawAnimationDelay);
+		clawAnimation.clip = clawClip;
 	}
 
 	virtual void think(real32 time_delta) override;
 	void render(SDL_Renderer* renderer) override;
 	virtual void update(real32 time_delta, const ControllerInput* input) override;
 
-	SDL_Texture* textureClaw;
-	SDL_Point textureClawSize = {0, 0};
-	SDL_Texture* textureClawAttack;
-	SDL_Point textureClawAttackSize = {0, 0};
-	SDL_Texture* currentClawTexture;
-	SDL_Point currentClawTextureSize = {0, 0};
-	uint32 currentClawFrame = 0;
-	real32 lastClawAnimationTime = 0;
+	const AnimationClip* clawClip;
+	const AnimationClip* clawAttackClip;
+	AnimationCursor clawAnimation;
+	const real32 clawAnimationDelay = 0.3f;
 	bool targetingPlayer = false;
 	bool vigilant = false;
 	real32 waveTimer = 0;
@@ -1323,6 +1788,7 @@ public:
 
 	virtual void think(real32 time_delta) override {};
 	virtual void update(real32 time_delta, const ControllerInput* input) override;
+	virtual void die() override;
 
 	real32 lifespan;
 	bool isBig;
@@ -1356,12 +1822,10 @@ public:
 
 		setTexture(enemy_boss_texture_main_normal, TextureType::Idle);
 		
-		textureClaw = enemy_boss_texture_claw_normal;
-		SDL_QueryTexture(textureClaw, NULL, NULL, &textureClawSize.x, &textureClawSize.y);
 		textureSmallclaw = enemy_boss_texture_smallclaw_normal;
-		SDL_QueryTexture(textureSmallclaw, NULL, NULL, &textureSmallclawSize.x, &textureSmallclawSize.y);
 		textureMainStunned = enemy_boss_texture_main_crouched;
-		SDL_QueryTexture(textureMainStunned, NULL, NULL, &textureMainStunnedSize.x, &textureMainStunnedSize.y);
+		clawClip = animation_library.get(enemy_boss_texture_claw_normal, (int32)width, (int32)height, 0.03f, 0, AnimationLoop::Once);
+		stunClip = animation_library.get(stun_texture, 687, 348, 0.1f);
 	}
 
 	virtual void think(real32 time_delta) override;
@@ -1371,14 +1835,13 @@ public:
 	void sweepAttack(real32 time_delta);
 	void bigBubbleAttack(real32 time_delta);
 	void changeState(BossState newState);
+	void updateClawHitboxes();
 	virtual void die() override;
 
-	SDL_Texture* textureClaw;
-	SDL_Point textureClawSize = {0, 0};
 	SDL_Texture* textureSmallclaw;
-	SDL_Point textureSmallclawSize = {0, 0};
 	SDL_Texture* textureMainStunned;
-	SDL_Point textureMainStunnedSize = {0, 0};
+	const AnimationClip* clawClip;
+	const AnimationClip* stunClip;
 	bool active = false;
 	real32 shootCooldown = 1.f;
 	real32 idleDelay = 0;
@@ -1392,9 +1855,11 @@ public:
 	real32 clawAngleWave = 0;
 	real32 clawPosYWave = 0;
 	real32 smallclawAngle = 0;
-	int32 stun_frame = 0;
-	int32 clawFrame = 0;
+	uint32 stunFrame = 0;
+	uint32 clawFrame = 0;
 	std::array<Rect2f, 3> clawHitRects = {Rect2f(673, 215, 548, 570), Rect2f(699, 702, 441, 305), Rect2f(765, 1014, 298, 260)};
+	// clawHitRects in world space, rotated with the claw sprite. Updated once per frame.
+	std::array<OrientedRect2f, 3> clawHitboxes;
 	Rect2f buttRect = {129, 929, 434, 388};
 	const real32 shootPeriod = 1.f;
 	const SDL_FPoint claw_normal_offset = {-63, -493};
@@ -1415,6 +1880,13 @@ struct EnemySpawner
 {
 	Vector2f spawnPoint;
 	EnemyType enemyType;
+	// Streaming state. The enemy spawns when this chunk loads and is saved back here when its chunk unloads.
+	uint32 chunk = 0;
+	bool alive = false;
+	bool defeated = false;
+	bool hasSavedState = false;
+	Vector2f savedPosition;
+	int32 savedHealth = 0;
 };
 
 struct DecorSpawner {
@@ -1428,34 +1900,419 @@ struct DiagSpawner {
 	DiagDir direction;
 };
 
+// Tiles as the level image has them. Kept for the whole level, so chunks can be rebuilt after unloading.
+enum class TileKind : uint8
+{
+	None, Top, Mid, Breakable, Moving
+};
+
+// Chunks are square blocks of cells that are loaded and unloaded together
+constexpr int32 level_chunk_cells = 32;
+// Chunks within this distance of the camera are loaded ahead of time, a few per frame
+constexpr real32 level_stream_margin = level_chunk_cells * LEVEL_SCALE;
+constexpr int32 level_chunk_loads_per_frame = 2;
+// Chunks stay loaded after the camera leaves until there are more than this many, then the farthest go
+constexpr uint32 level_chunk_budget = 48;
+
+// Where a moving solid was when its chunk unloaded. It carries on from there when the chunk loads again.
+struct SavedMovingSolid
+{
+	// Cell of its tile, where it started
+	uint32 cell;
+	Vector2f position;
+	Vector2f velocity;
+	real32 xRemainder;
+	real32 yRemainder;
+};
+
+struct LevelChunk
+{
+	bool loaded = false;
+	// Indices into Level::solids
+	std::vector<uint32> solids;
+	// Moving solids overlapping each cell of the chunk, only allocated while loaded
+	std::vector<std::vector<uint32>> movingSolidCells;
+	// The chunk's moving solids while it is unloaded
+	std::vector<SavedMovingSolid> savedMovingSolids;
+	// Spawners placed in this chunk
+	std::vector<uint32> decorSpawners;
+	std::vector<uint32> diagSpawners;
+};
+
 struct ButtonSpawner {
 	Vector2f spawnPoint;
 	bool isInverted;
 };
 
-struct Level
+// Spawners in the order the columns of the level image are read in, which decides what is drawn on top
+template <typename Spawner>
+void sortSpawners(std::vector<Spawner>& spawners) {
+	std::stable_sort(spawners.begin(), spawners.end(), [](const Spawner& a, const Spawner& b) {
+		return a.spawnPoint.x < b.spawnPoint.x || (a.spawnPoint.x == b.spawnPoint.x && a.spawnPoint.y < b.spawnPoint.y);
+	});
+}
+
+// The single actors whose start points the level image sets
+enum class LevelStart : uint8
 {
-	std::vector<Solid> solids;
-	std::unordered_map<Vector2f, Solid*> solidMap;
-	Vector2f playerStart;
-	Vector2f keyStart;
-	Vector2f doorStart;
-	Vector2f heartStart;
-	Vector2f grampaStart;
-	std::vector<EnemySpawner> enemySpawners;
-	std::vector<DecorSpawner> decorSpawners;
+	Player, Key, Door, Heart, Grampa
+};
+
+// What Level::parse does with a colour of the level image
+struct LevelColorAction
+{
+	PaletteKind kind = PaletteKind::Tile;
+	// TileKind, EnemyType, LevelStart or DiagDir by kind, 1 for inverted buttons
+	uint8 value = 0;
+	// Decor image, index into the table's decor textures
+	uint16 decor = 0;
+	Vector2f size;
+	// False for lines of the palette naming something the game does not have
+	bool spawns = false;
+};
+
+/// The palette from level_palette.txt resolved to the game's types, so Level::parse looks each colour up instead of
+/// comparing it to every known one. Colours with new decor images or other existing kinds need no code change.
+class LevelColorTable
+{
+public:
+	/// Reads the palette the first time it is called
+	void load() {
+		if (loaded) {
+			return;
+		}
+		loaded = true;
+
+		std::string error;
+		if (!palette.load(level_palette_filename, error)) {
+			LogError("Failed to load the level palette: %s", error.c_str());
+			return;
+		}
+		const std::vector<PaletteEntry>& entries = palette.getEntries();
+		actions.assign(entries.size(), {});
+		for (size_t i = 0; i < entries.size(); ++i) {
+			const PaletteEntry& entry = entries[i];
+			LevelColorAction& action = actions[i];
+			action.kind = entry.kind;
+			int32 value = -1;
+			switch (entry.kind) {
+			case PaletteKind::Tile:
+				// TileKind::None is not in the palette
+				value = findName(entry.name, {"top", "mid", "breakable", "moving"}) + 1;
+				value = value > 0 ? value : -1;
+				break;
+			case PaletteKind::Enemy:
+				value = findName(entry.name, {"fish", "shrimp", "jellyfish", "boss", "shrimp_inverted"});
+				break;
+			case PaletteKind::Start:
+				value = findName(entry.name, {"player", "key", "door", "heart", "grampa"});
+				break;
+			case PaletteKind::Button:
+				value = findName(entry.name, {"normal", "inverted"});
+				break;
+			case PaletteKind::Diagonal:
+				value = findName(entry.name, {"top_left", "top_right", "bot_left", "bot_right"});
+				break;
+			case PaletteKind::Decor:
+				value = 0;
+				action.decor = (uint16)addDecor(entry.name);
+				action.size = Vector2f((real32)entry.width, (real32)entry.height);
+				break;
+			}
+			if (value < 0) {
+				LogError("Level palette: there is no %s called %s", palette_kind_names[(size_t)entry.kind], entry.name.c_str());
+				continue;
+			}
+			action.value = (uint8)value;
+			action.spawns = true;
+		}
+	}
+
+	/// What the colour spawns, null for empty water
+	const LevelColorAction* find(uint32 color) const {
+		const int32 index = palette.find(color);
+		return index >= 0 && actions[index].spawns ? &actions[index] : nullptr;
+	}
+
+	uint32 getDecorCount() const {
+		return (uint32)decorFiles.size();
+	}
+
+	const std::string& getDecorFile(uint32 decor) const {
+		return decorFiles[decor];
+	}
+
+	SDL_Texture* getDecorTexture(uint32 decor) const {
+		return decorTextures[decor];
+	}
+
+	void setDecorTexture(uint32 decor, SDL_Texture* texture) {
+		decorTextures[decor] = texture;
+	}
+
+private:
+	static int32 findName(const std::string& name, std::initializer_list<const char*> names) {
+		int32 index = 0;
+		for (const char* candidate : names) {
+			if (name == candidate) {
+				return index;
+			}
+			index++;
+		}
+		return -1;
+	}
+
+	/// Decors sharing an image share its texture
+	uint32 addDecor(const std::string& file) {
+		for (uint32 i = 0; i < decorFiles.size(); ++i) {
+			if (decorFiles[i] == file) {
+				return i;
+			}
+		}
+		decorFiles.push_back(file);
+		decorTextures.push_back(nullptr);
+		return (uint32)decorFiles.size() - 1;
+	}
+
+	LevelPalette palette;
+	// Parallel to the palette entries
+	std::vector<LevelColorAction> actions;
+	std::vector<std::string> decorFiles;
+	std::vector<SDL_Texture*> decorTextures;
+	bool loaded = false;
+};
+
+LevelColorTable level_colors;
+
+// Cells of a level that are not Solid objects. A slope is named after the corner its solid half is in.
+enum class TileShape : uint8
+{
+	Empty, Full, SlopeTopLeft, SlopeTopRight, SlopeBotLeft, SlopeBotRight
+};
+
+struct RayHit
+{
+	// Where the ray enters the first blocked cell
+	Vector2f point;
+	int32 cellX = 0;
+	int32 cellY = 0;
+};
+
+// Inclusive range of grid cells, empty when right < left or bottom < top
+struct CellRange
+{
+	int32 left = 0;
+	int32 top = 0;
+	int32 right = -1;
+	int32 bottom = -1;
+
+	bool operator==(const CellRange& b) const
+	{
+		return left == b.left && top == b.top && right == b.right && bottom == b.bottom;
+	}
+};
+
+struct Level
+{
+	// Solids of the loaded chunks. Slots of unloaded chunks are reused, so indices stay valid while loaded.
+	std::vector<Solid> solids;
+	std::vector<uint32> freeSolids;
+	Vector2f playerStart;
+	Vector2f keyStart;
+	Vector2f doorStart;
+	Vector2f heartStart;
+	Vector2f grampaStart;
+	std::vector<EnemySpawner> enemySpawners;
+	std::vector<DecorSpawner> decorSpawners;
 	std::vector<DiagSpawner> diagSpawners;
 	std::vector<ButtonSpawner> buttonSpawners;
 	uint32 width;
 	uint32 height;
 	bool heartTaken = false;
 
+	/// Places a tile at cell (i, j) while playing. It is created right away if its chunk is loaded.
 	void addSolid(Solid solid, int32 i, int32 j) {
-		solids.emplace_back(solid);
-		solidMap[{(float)(i * LEVEL_SCALE), (float)(j * LEVEL_SCALE)}] = &solids[solids.size()-1];
+		if (i < 0 || j < 0 || i >= gridWidth || j >= gridHeight) {
+			return;
+		}
+		const uint32 cell = j * gridWidth + i;
+		tileCells[cell] = (uint8)(solid.doesMove ? TileKind::Moving : solid.breakable ? TileKind::Breakable :
+		                          solid.texture == tile1_texture_top ? TileKind::Top : TileKind::Mid);
+		if (!solid.doesMove) {
+			blockedCells[cell] = 1;
+			gridVersion++;
+			updateClearance(i, j);
+		}
+		LevelChunk& chunk = chunks[getChunkIndex(i, j)];
+		if (chunk.loaded) {
+			chunk.solids.push_back(createSolid(solid, i, j));
+		}
+	}
+
+	uint32 createSolid(const Solid& solid, int32 i, int32 j) {
+		uint32 index;
+		if (!freeSolids.empty()) {
+			index = freeSolids.back();
+			freeSolids.pop_back();
+			solids[index] = solid;
+		}
+		else {
+			index = (uint32)solids.size();
+			solids.push_back(solid);
+		}
+
+		if (solid.doesMove) {
+			movingSolids.push_back(index);
+			insertMovingSolid(index, getCellRange(solid.getRect()));
+		}
+		else {
+			staticSolidCells[j * gridWidth + i] = (int32)index;
+		}
+		return index;
+	}
+
+	void freeSolid(uint32 index) {
+		Solid& solid = solids[index];
+		if (solid.doesMove) {
+			removeMovingSolid(index, getCellRange(solid.getRect()));
+			deleteFromVector(movingSolids, index);
+		}
+		else {
+			const uint32 cell = getCellIndex(solid.position);
+			if (staticSolidCells[cell] == (int32)index) {
+				staticSolidCells[cell] = -1;
+			}
+		}
+		// Free slots are skipped like broken tiles
+		solid.collidable = false;
+		solid.broken = true;
+		freeSolids.push_back(index);
+	}
+
+	inline uint32 getChunkIndex(int32 i, int32 j) const {
+		return (j / level_chunk_cells) * chunksX + i / level_chunk_cells;
 	}
 
-	void load(const std::string& levelFilename)
+	/// Chunks touched by a rect, clamped to the level
+	CellRange getChunkRange(const Rect2f& rect) const {
+		const CellRange cells = getCellRange(rect);
+		return {cells.left / level_chunk_cells, cells.top / level_chunk_cells,
+		        cells.right < 0 ? -1 : cells.right / level_chunk_cells, cells.bottom < 0 ? -1 : cells.bottom / level_chunk_cells};
+	}
+
+	Rect2f getChunkRect(uint32 chunk) const {
+		const real32 chunkSize = level_chunk_cells * LEVEL_SCALE;
+		return {(chunk % chunksX) * chunkSize, (chunk / chunksX) * chunkSize, chunkSize, chunkSize};
+	}
+
+	/// Creates the solids of a chunk from the tile cells
+	void loadChunk(uint32 index) {
+		LevelChunk& chunk = chunks[index];
+		if (chunk.loaded) {
+			return;
+		}
+		chunk.loaded = true;
+		chunk.movingSolidCells.resize(level_chunk_cells * level_chunk_cells);
+		loadedChunkCount++;
+
+		const int32 left = (index % chunksX) * level_chunk_cells;
+		const int32 top = (index / chunksX) * level_chunk_cells;
+		const int32 right = MIN(left + level_chunk_cells, gridWidth);
+		const int32 bottom = MIN(top + level_chunk_cells, gridHeight);
+		for (int32 j = top; j < bottom; ++j) {
+			for (int32 i = left; i < right; ++i) {
+				const TileKind kind = (TileKind)tileCells[j * gridWidth + i];
+				if (kind == TileKind::None) {
+					continue;
+				}
+				const Vector2f position = {(real32)(i * LEVEL_SCALE), (real32)(j * LEVEL_SCALE)};
+				Solid solid = kind == TileKind::Top ? Solid(position, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_top) :
+				              kind == TileKind::Mid ? Solid(position, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_mid) :
+				              kind == TileKind::Breakable ? Solid(position, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_breakable, true, true) :
+				              Solid(position, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_mid, true, false, true);
+				// Neighbours come from the tile cells, so this works across unloaded chunks
+				solid.prepare(this);
+				if (kind == TileKind::Moving) {
+					restoreMovingSolid(chunk, j * gridWidth + i, solid);
+				}
+				chunk.solids.push_back(createSolid(solid, i, j));
+			}
+		}
+		chunk.savedMovingSolids.clear();
+
+		// Moving solids of other chunks that already reach into this one
+		const Rect2f chunkRect = getChunkRect(index);
+		for (const uint32 moving : movingSolids) {
+			const Rect2f rect = solids[moving].getRect();
+			if (rect.collides(chunkRect) && std::find(chunk.solids.begin(), chunk.solids.end(), moving) == chunk.solids.end()) {
+				insertMovingSolid(moving, getCellRange(rect));
+			}
+		}
+	}
+
+	/// Frees the solids of a chunk. Tiles broken or placed while it was loaded are already in the tile cells,
+	/// moving solids are saved into the chunk.
+	void unloadChunk(uint32 index) {
+		LevelChunk& chunk = chunks[index];
+		if (!chunk.loaded) {
+			return;
+		}
+		for (const uint32 solid : chunk.solids) {
+			const Solid& moving = solids[solid];
+			if (moving.doesMove) {
+				chunk.savedMovingSolids.push_back({getCellIndex(moving.orgPosition), moving.position, moving.velocity,
+				                                   moving.xRemainder, moving.yRemainder});
+			}
+			freeSolid(solid);
+		}
+		chunk.solids.clear();
+		chunk.loaded = false;
+		loadedChunkCount--;
+		std::vector<std::vector<uint32>>().swap(chunk.movingSolidCells);
+	}
+
+	/// Unloads everything for a restart, so the moving solids go back to their tiles
+	void unloadAllChunks() {
+		for (LevelChunk& chunk : chunks) {
+			unloadChunk((uint32)(&chunk - chunks.data()));
+			chunk.savedMovingSolids.clear();
+		}
+		solids.clear();
+		freeSolids.clear();
+	}
+
+	/// Puts a moving solid created from its tile back where it was when its chunk unloaded
+	void restoreMovingSolid(const LevelChunk& chunk, uint32 cell, Solid& solid) {
+		for (const SavedMovingSolid& saved : chunk.savedMovingSolids) {
+			if (saved.cell == cell) {
+				solid.position = saved.position;
+				solid.velocity = saved.velocity;
+				solid.xRemainder = saved.xRemainder;
+				solid.yRemainder = saved.yRemainder;
+				solid.dest_rect.x = solid.position.x;
+				solid.dest_rect.y = solid.position.y;
+				return;
+			}
+		}
+	}
+
+	/// Puts back every tile from the level image, for levels that are rebuilt when restarted
+	void restoreTiles() {
+		unloadAllChunks();
+		tileCells = originalTiles;
+		for (size_t i = 0; i < tileCells.size(); ++i) {
+			const TileKind kind = (TileKind)tileCells[i];
+			blockedCells[i] = (kind != TileKind::None && kind != TileKind::Moving) || shapeCells[i] != (uint8)TileShape::Empty;
+		}
+		gridVersion++;
+		buildClearance();
+	}
+
+	/// Copies the parsed level from level_cache, the image is only decoded the first time it is loaded
+	void load(const std::string& levelFilename);
+
+	/// Decodes the level image. Levels are loaded through level_cache, only it calls this.
+	void parse(const std::string& levelFilename)
 	{
 		SDL_Surface* surface = IMG_Load(("assets/" + levelFilename).c_str());
 		if (!surface)
@@ -1466,151 +2323,935 @@ struct Level
 
 		LogInfo("W: %d, H: %d\n", surface->w, surface->h);
 
+		enemySpawners.clear();
+		decorSpawners.clear();
+		diagSpawners.clear();
+		buttonSpawners.clear();
+		solids.clear();
+		freeSolids.clear();
+		loadedChunkCount = 0;
+		playerStart = keyStart = doorStart = heartStart = grampaStart = {0, 0};
+		heartTaken = false;
+
 		this->width = surface->w * LEVEL_SCALE;
 		this->height = surface->h * LEVEL_SCALE;
-		for (int i = 0; i < surface->w; i++)
+		gridWidth = surface->w;
+		gridHeight = surface->h;
+		blockedCells.assign(gridWidth * gridHeight, 0);
+		shapeCells.assign(gridWidth * gridHeight, (uint8)TileShape::Empty);
+		hasShapes = false;
+		tileCells.assign(gridWidth * gridHeight, (uint8)TileKind::None);
+		staticSolidCells.assign(gridWidth * gridHeight, -1);
+		movingSolids.clear();
+		chunksX = (gridWidth + level_chunk_cells - 1) / level_chunk_cells;
+		chunksY = (gridHeight + level_chunk_cells - 1) / level_chunk_cells;
+		chunks.assign(chunksX * chunksY, {});
+		// One conversion to the format the palette is written in, then the rows are read as plain pixels. Most
+		// neighbouring pixels have the same colour, so the lookup is only done when it changes.
+		level_colors.load();
+		SDL_Surface* pixels = surface->format->format == SDL_PIXELFORMAT_ABGR8888 ? surface : SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+		if (!pixels)
+		{
+			LogError("Failed to convert level file: %s", levelFilename.c_str());
+			SDL_FreeSurface(surface);
+			return;
+		}
+		if (SDL_MUSTLOCK(pixels))
 		{
-			// printf("\n");
-			for (int j = 0; j < surface->h; j++)
+			SDL_LockSurface(pixels);
+		}
+		uint32 lastColor = 0;
+		const LevelColorAction* action = level_colors.find(lastColor);
+		for (int32 j = 0; j < gridHeight; j++)
+		{
+			const uint32* row = (const uint32*)((const uint8*)pixels->pixels + j * pixels->pitch);
+			for (int32 i = 0; i < gridWidth; i++)
 			{
-				uint32 p = getPixel(surface, i, j);
-				// printf("%x", p);
-
-				// Tiles
-				if (p == 0xff000000)
+				if (row[i] != lastColor)
 				{
-					addSolid(Solid({static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)}, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_top), i, j);
+					lastColor = row[i];
+					action = level_colors.find(lastColor);
 				}
-				else if (p == 0xff808080)
+				if (action)
 				{
-					addSolid(Solid({static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)}, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_mid), i, j);
-				}
-				else if (p == 0xff00337F)
-				{
-					addSolid(Solid({static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)}, LEVEL_SCALE, LEVEL_SCALE, tile1_texture_breakable, true, true), i, j);
+					spawnFromColor(i, j, *action);
 				}
+			}
+		}
+		if (SDL_MUSTLOCK(pixels))
+		{
+			SDL_UnlockSurface(pixels);
+		}
+		if (pixels != surface)
+		{
+			SDL_FreeSurface(pixels);
+		}
 
-				// Actors
-				else if (p == 0xffff0000)
-				{
-					playerStart = {static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)};
-				}
-				else if (p == 0xff0000ff)
-				{
-					enemySpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), EnemyType::Fish);
-				}
-				else if (p == 0xffdc00ff)
-				{
-					enemySpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), EnemyType::Jellyfish);
+		sortSpawners(enemySpawners);
+		sortSpawners(decorSpawners);
+		sortSpawners(diagSpawners);
+		sortSpawners(buttonSpawners);
+		for (const DiagSpawner& spawner : diagSpawners) {
+			addDiagonal((int32)(spawner.spawnPoint.x / LEVEL_SCALE), (int32)(spawner.spawnPoint.y / LEVEL_SCALE), spawner.direction);
+		}
+
+		SDL_FreeSurface(surface);
+		originalTiles = tileCells;
+
+		for (EnemySpawner& spawner : enemySpawners) {
+			spawner.chunk = getChunkIndex(MIN((int32)(spawner.spawnPoint.x / LEVEL_SCALE), gridWidth - 1),
+			                              MIN((int32)(spawner.spawnPoint.y / LEVEL_SCALE), gridHeight - 1));
+		}
+		for (uint32 i = 0; i < decorSpawners.size(); ++i) {
+			const Vector2f point = decorSpawners[i].spawnPoint;
+			chunks[getChunkIndex((int32)(point.x / LEVEL_SCALE), (int32)(point.y / LEVEL_SCALE))].decorSpawners.push_back(i);
+		}
+		for (uint32 i = 0; i < diagSpawners.size(); ++i) {
+			const Vector2f point = diagSpawners[i].spawnPoint;
+			chunks[getChunkIndex((int32)(point.x / LEVEL_SCALE), (int32)(point.y / LEVEL_SCALE))].diagSpawners.push_back(i);
+		}
+		buildClearance();
+		loaded = true;
+	}
+
+	/// Diagonals are only recorded here, parse adds their shapes once they are in order
+	void spawnFromColor(int32 i, int32 j, const LevelColorAction& action) {
+		const Vector2f point = {(real32)(i * LEVEL_SCALE), (real32)(j * LEVEL_SCALE)};
+		switch (action.kind) {
+		case PaletteKind::Tile:
+			setTile(i, j, (TileKind)action.value);
+			break;
+		case PaletteKind::Enemy:
+			enemySpawners.emplace_back(point, (EnemyType)action.value);
+			break;
+		case PaletteKind::Start:
+			switch ((LevelStart)action.value) {
+			case LevelStart::Player: playerStart = point; break;
+			case LevelStart::Key: keyStart = point; break;
+			case LevelStart::Door: doorStart = point; break;
+			case LevelStart::Heart: heartStart = point; break;
+			case LevelStart::Grampa: grampaStart = point; break;
+			}
+			break;
+		case PaletteKind::Button:
+			buttonSpawners.emplace_back(point, action.value != 0);
+			break;
+		case PaletteKind::Decor:
+			decorSpawners.emplace_back(point, action.size, level_colors.getDecorTexture(action.decor));
+			break;
+		case PaletteKind::Diagonal:
+			diagSpawners.emplace_back(point, (DiagDir)action.value);
+			break;
+		}
+	}
+
+	void setTile(int32 i, int32 j, TileKind kind) {
+		tileCells[j * gridWidth + i] = (uint8)kind;
+		if (kind != TileKind::Moving) {
+			blockedCells[j * gridWidth + i] = 1;
+		}
+	}
+
+	/// Cells touched by a rect, clamped to the level
+	CellRange getCellRange(const Rect2f& rect) const {
+		CellRange range;
+		range.left = MAX((int32)floorf(rect.x / LEVEL_SCALE), 0);
+		range.top = MAX((int32)floorf(rect.y / LEVEL_SCALE), 0);
+		range.right = MIN((int32)ceilf((rect.x + rect.w) / LEVEL_SCALE) - 1, gridWidth - 1);
+		range.bottom = MIN((int32)ceilf((rect.y + rect.h) / LEVEL_SCALE) - 1, gridHeight - 1);
+		return range;
+	}
+
+	/// First collidable solid overlapping the rect. Only looks at the cells under the rect.
+	const Solid* findSolid(const Rect2f& rect) const {
+		const CellRange range = getCellRange(rect);
+		for (int32 y = range.top; y <= range.bottom; ++y) {
+			for (int32 x = range.left; x <= range.right; ++x) {
+				const uint32 cell = y * gridWidth + x;
+				const int32 index = staticSolidCells[cell];
+				if (index >= 0 && solids[index].collidable && rect.collides(solids[index].getRect())) {
+					return &solids[index];
 				}
-				else if (p == 0xffffff00)
-				{
-					enemySpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), EnemyType::Shrimp);
+				if (movingSolids.empty()) {
+					continue;
 				}
-				else if (p == 0xff898900)
-				{
-					enemySpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), EnemyType::ShrimpInverted);
+				const std::vector<uint32>* movingCell = getMovingSolidCell(x, y);
+				if (!movingCell) {
+					continue;
 				}
-				else if (p == 0xffFF007F)
-				{
-					enemySpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), EnemyType::Boss);
+				for (const uint32 moving : *movingCell) {
+					if (solids[moving].collidable && rect.collides(solids[moving].getRect())) {
+						return &solids[moving];
+					}
 				}
-				else if (p == 0xff5BFCFF)
-				{
-					keyStart = {static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)};
+			}
+		}
+		return nullptr;
+	}
+
+	/// The moving solids list of a cell, null when its chunk is not loaded
+	inline std::vector<uint32>* getMovingSolidCell(int32 i, int32 j) {
+		LevelChunk& chunk = chunks[getChunkIndex(i, j)];
+		if (!chunk.loaded) {
+			return nullptr;
+		}
+		return &chunk.movingSolidCells[(j % level_chunk_cells) * level_chunk_cells + i % level_chunk_cells];
+	}
+
+	inline const std::vector<uint32>* getMovingSolidCell(int32 i, int32 j) const {
+		return const_cast<Level*>(this)->getMovingSolidCell(i, j);
+	}
+
+	void breakSolid(const Solid* solid) {
+		const uint32 index = (uint32)(solid - solids.data());
+		Solid& target = solids[index];
+		target.collidable = false;
+		target.broken = true;
+		const uint32 cell = getCellIndex(target.position);
+		if (staticSolidCells[cell] == (int32)index) {
+			staticSolidCells[cell] = -1;
+		}
+		tileCells[cell] = (uint8)TileKind::None;
+		clearCell(target.position);
+		updateClearance(cell % gridWidth, cell / gridWidth);
+	}
+
+	/// Moves a moving solid between broadphase cells. Most moves stay inside the same cells and cost nothing.
+	void updateMovingSolidCells(uint32 index, const Rect2f& oldRect, const Rect2f& newRect) {
+		const CellRange oldRange = getCellRange(oldRect);
+		const CellRange newRange = getCellRange(newRect);
+		if (oldRange == newRange) {
+			return;
+		}
+		removeMovingSolid(index, oldRange);
+		insertMovingSolid(index, newRange);
+	}
+
+	void updateMovingSolids(real32 time_delta) {
+		for (const uint32 index : movingSolids) {
+			solids[index].update(time_delta);
+		}
+	}
+
+	bool checkSolid(const Vector2f& pos) {
+		if (pos.x < 0 || pos.x >= width || pos.y < 0 || pos.y >= height) {
+			return true;
+		}
+		return tileCells[getCellIndex(pos)] != (uint8)TileKind::None;
+	}
+
+	inline uint32 getCellIndex(Vector2f pos) const {
+		return (uint32)(pos.y / LEVEL_SCALE) * gridWidth + (uint32)(pos.x / LEVEL_SCALE);
+	}
+
+	/// The fully solid cells behind a slope count as static tiles, so the clearance runs and puff checks see them
+	inline bool isStaticTile(uint32 cell) const {
+		return (tileCells[cell] != (uint8)TileKind::None && tileCells[cell] != (uint8)TileKind::Moving)
+			|| shapeCells[cell] == (uint8)TileShape::Full;
+	}
+
+	/// Recounts the free runs of every row and column, after loading or restoring the tiles
+	void buildClearance() {
+		clearLeft.assign(gridWidth * gridHeight, 0);
+		clearRight.assign(gridWidth * gridHeight, 0);
+		clearUp.assign(gridWidth * gridHeight, 0);
+		clearDown.assign(gridWidth * gridHeight, 0);
+		for (int32 j = 0; j < gridHeight; ++j) {
+			updateClearanceRow(j);
+		}
+		// Columns a whole row at a time, going down the cells of a column one by one misses the cache
+		for (int32 j = 0; j < gridHeight; ++j) {
+			for (int32 i = 0; i < gridWidth; ++i) {
+				const uint32 cell = j * gridWidth + i;
+				clearUp[cell] = isStaticTile(cell) ? 0 : (uint16)MIN((j > 0 ? clearUp[cell - gridWidth] : 0) + 1, UINT16_MAX);
+			}
+		}
+		for (int32 j = gridHeight - 1; j >= 0; --j) {
+			for (int32 i = 0; i < gridWidth; ++i) {
+				const uint32 cell = j * gridWidth + i;
+				clearDown[cell] = isStaticTile(cell) ? 0 : (uint16)MIN((j < gridHeight - 1 ? clearDown[cell + gridWidth] : 0) + 1, UINT16_MAX);
+			}
+		}
+	}
+
+	/// A tile at (i, j) was placed or broken, only its row and column change
+	void updateClearance(int32 i, int32 j) {
+		updateClearanceRow(j);
+		updateClearanceColumn(i);
+	}
+
+	void updateClearanceRow(int32 j) {
+		const uint32 row = j * gridWidth;
+		uint16 run = 0;
+		for (int32 i = 0; i < gridWidth; ++i) {
+			run = isStaticTile(row + i) ? 0 : (uint16)MIN(run + 1, UINT16_MAX);
+			clearLeft[row + i] = run;
+		}
+		run = 0;
+		for (int32 i = gridWidth - 1; i >= 0; --i) {
+			run = isStaticTile(row + i) ? 0 : (uint16)MIN(run + 1, UINT16_MAX);
+			clearRight[row + i] = run;
+		}
+	}
+
+	void updateClearanceColumn(int32 i) {
+		uint16 run = 0;
+		for (int32 j = 0; j < gridHeight; ++j) {
+			run = isStaticTile(j * gridWidth + i) ? 0 : (uint16)MIN(run + 1, UINT16_MAX);
+			clearUp[j * gridWidth + i] = run;
+		}
+		run = 0;
+		for (int32 j = gridHeight - 1; j >= 0; --j) {
+			run = isStaticTile(j * gridWidth + i) ? 0 : (uint16)MIN(run + 1, UINT16_MAX);
+			clearDown[j * gridWidth + i] = run;
+		}
+	}
+
+	/// First static tile under the rect in the order findSolid scans the cells, -1 for none. Reads one free run
+	/// per row or per column, whichever the rect has fewer of, so the thin hitbox strips cost one or two lookups.
+	int32 findStaticTile(const Rect2f& rect) const {
+		const CellRange range = getCellRange(rect);
+		const int32 rows = range.bottom - range.top + 1;
+		const int32 columns = range.right - range.left + 1;
+		if (rows <= 0 || columns <= 0) {
+			return -1;
+		}
+		if (rows <= columns) {
+			for (int32 y = range.top; y <= range.bottom; ++y) {
+				const int32 free = clearRight[y * gridWidth + range.left];
+				if (free < columns) {
+					return y * gridWidth + range.left + free;
 				}
-				else if (p == 0xffC5FFAA)
-				{
-					doorStart = {static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)};
+			}
+			return -1;
+		}
+		int32 found = -1;
+		int32 foundRow = range.bottom + 1;
+		for (int32 x = range.left; x <= range.right; ++x) {
+			const int32 free = clearDown[range.top * gridWidth + x];
+			if (free < rows && range.top + free < foundRow) {
+				foundRow = range.top + free;
+				found = foundRow * gridWidth + x;
+			}
+		}
+		return found;
+	}
+
+	inline Rect2f getCellRect(uint32 cell) const {
+		return {(real32)(cell % gridWidth) * LEVEL_SCALE, (real32)(cell / gridWidth) * LEVEL_SCALE, LEVEL_SCALE, LEVEL_SCALE};
+	}
+
+	/// First moving solid overlapping the rect. Only looks at the moving solid cells under the rect.
+	const Solid* findMovingSolid(const Rect2f& rect) const {
+		if (movingSolids.empty()) {
+			return nullptr;
+		}
+		const CellRange range = getCellRange(rect);
+		for (int32 y = range.top; y <= range.bottom; ++y) {
+			for (int32 x = range.left; x <= range.right; ++x) {
+				const std::vector<uint32>* movingCell = getMovingSolidCell(x, y);
+				if (!movingCell) {
+					continue;
 				}
-				else if (p == 0xff99BCFF)
-				{
-					buttonSpawners.emplace_back(Vector2f(static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)), false);
+				for (const uint32 moving : *movingCell) {
+					if (solids[moving].collidable && rect.collides(solids[moving].getRect())) {
+						return &solids[moving];
+					}
 				}
-				else if (p == 0xff63B6FF)
-				{
-					buttonSpawners.emplace_back(Vector2f(static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)), true);
+			}
+		}
+		return nullptr;
+	}
+
+	/// Tiles that do not move, one byte per cell. Used for pathfinding.
+	inline bool isCellBlocked(int32 i, int32 j) const {
+		return i < 0 || j < 0 || i >= gridWidth || j >= gridHeight || blockedCells[j * gridWidth + i];
+	}
+
+	void insertMovingSolid(uint32 index, const CellRange& range) {
+		for (int32 y = range.top; y <= range.bottom; ++y) {
+			for (int32 x = range.left; x <= range.right; ++x) {
+				if (std::vector<uint32>* cell = getMovingSolidCell(x, y)) {
+					cell->push_back(index);
 				}
-				else if (p == 0xffDAD6FF)
-				{
-					heartStart = {static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)};
+			}
+		}
+	}
+
+	void removeMovingSolid(uint32 index, const CellRange& range) {
+		for (int32 y = range.top; y <= range.bottom; ++y) {
+			for (int32 x = range.left; x <= range.right; ++x) {
+				std::vector<uint32>* cell = getMovingSolidCell(x, y);
+				if (!cell) {
+					continue;
 				}
-				else if (p == 0xff63607C)
-				{
-					grampaStart = {static_cast<float>(i * LEVEL_SCALE), static_cast<float>(j * LEVEL_SCALE)};
+				for (size_t k = 0; k < cell->size(); ++k) {
+					if ((*cell)[k] == index) {
+						(*cell)[k] = cell->back();
+						cell->pop_back();
+						break;
+					}
 				}
+			}
+		}
+	}
 
-				// Decors
-				else if (p == 0xff00FF7F)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(320, 747), decor_texture_seaweed);
-				}
-				else if (p == 0xff7FE9FF)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(170, 188), decor_texture_coral1);
+	void clearCell(Vector2f pos) {
+		blockedCells[getCellIndex(pos)] = 0;
+		gridVersion++;
+	}
+
+	/// Fills the block of a diagonal marked at cell (i, j): slopes along the line, full cells behind it.
+	/// Matches where Diagonal draws its sprite.
+	void addDiagonal(int32 i, int32 j, DiagDir direction) {
+		const int32 last = diagonal_cells - 1;
+		const int32 left = (direction == DiagDir::TopRight || direction == DiagDir::BotRight) ? i - last : i;
+		const int32 top = (direction == DiagDir::BotLeft || direction == DiagDir::BotRight) ? j - last : j;
+		for (int32 v = 0; v < diagonal_cells; ++v) {
+			for (int32 u = 0; u < diagonal_cells; ++u) {
+				TileShape shape = TileShape::Empty;
+				switch (direction) {
+				case DiagDir::TopLeft:
+					shape = u + v < last ? TileShape::Full : u + v == last ? TileShape::SlopeTopLeft : TileShape::Empty;
+					break;
+				case DiagDir::TopRight:
+					shape = u > v ? TileShape::Full : u == v ? TileShape::SlopeTopRight : TileShape::Empty;
+					break;
+				case DiagDir::BotLeft:
+					shape = v > u ? TileShape::Full : u == v ? TileShape::SlopeBotLeft : TileShape::Empty;
+					break;
+				case DiagDir::BotRight:
+					shape = u + v > last ? TileShape::Full : u + v == last ? TileShape::SlopeBotRight : TileShape::Empty;
+					break;
 				}
-				else if (p == 0xff32d6ff)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(297, 368), decor_texture_coral2);
+				const int32 x = left + u;
+				const int32 y = top + v;
+				if (shape == TileShape::Empty || x < 0 || y < 0 || x >= gridWidth || y >= gridHeight) {
+					continue;
 				}
-				else if (p == 0xffffd1e1)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(895, 319), decor_texture_rock1);
+				shapeCells[y * gridWidth + x] = (uint8)shape;
+				blockedCells[y * gridWidth + x] = 1;
+				hasShapes = true;
+			}
+		}
+	}
+
+	/// Tests a hitbox against the shaped cells it overlaps. slopeNormal is set to the surface normal
+	/// when a slope was hit, and to zero for a full cell. penetration, if given, is how far the hitbox
+	/// reaches into the slope along either axis (a whole cell for a full one).
+	bool collideShapes(const Rect2f& hitbox, Vector2f* slopeNormal, real32* penetration = nullptr) const {
+		if (!hasShapes) {
+			return false;
+		}
+		const int32 left = MAX(0, (int32)floorf(hitbox.x / LEVEL_SCALE));
+		const int32 top = MAX(0, (int32)floorf(hitbox.y / LEVEL_SCALE));
+		const int32 right = MIN(gridWidth, (int32)ceilf((hitbox.x + hitbox.w) / LEVEL_SCALE));
+		const int32 bottom = MIN(gridHeight, (int32)ceilf((hitbox.y + hitbox.h) / LEVEL_SCALE));
+		for (int32 y = top; y < bottom; ++y) {
+			for (int32 x = left; x < right; ++x) {
+				const TileShape shape = (TileShape)shapeCells[y * gridWidth + x];
+				if (shape == TileShape::Empty) {
+					continue;
 				}
-				else if (p == 0xffffb2ef)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(455, 273), decor_texture_rock2);
+				if (shape == TileShape::Full) {
+					*slopeNormal = {0, 0};
+					if (penetration) {
+						*penetration = LEVEL_SCALE;
+					}
+					return true;
 				}
-				else if (p == 0xffdabaff)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(576, 590), decor_texture_rock3);
+
+				// Part of the hitbox inside the cell, in cell coordinates
+				const real32 cellX = (real32)x * LEVEL_SCALE;
+				const real32 cellY = (real32)y * LEVEL_SCALE;
+				const real32 x0 = MAX(hitbox.x, cellX) - cellX;
+				const real32 y0 = MAX(hitbox.y, cellY) - cellY;
+				const real32 x1 = MIN(hitbox.x + hitbox.w, cellX + LEVEL_SCALE) - cellX;
+				const real32 y1 = MIN(hitbox.y + hitbox.h, cellY + LEVEL_SCALE) - cellY;
+				// Only the hitbox corner nearest the solid corner can reach into the triangle
+				real32 depth = 0;
+				switch (shape) {
+				case TileShape::SlopeTopLeft:
+					depth = LEVEL_SCALE - (x0 + y0);
+					*slopeNormal = {0.7071f, 0.7071f};
+					break;
+				case TileShape::SlopeTopRight:
+					depth = x1 - y0;
+					*slopeNormal = {-0.7071f, 0.7071f};
+					break;
+				case TileShape::SlopeBotLeft:
+					depth = y1 - x0;
+					*slopeNormal = {0.7071f, -0.7071f};
+					break;
+				default:
+					depth = x1 + y1 - LEVEL_SCALE;
+					*slopeNormal = {-0.7071f, -0.7071f};
+					break;
 				}
-				else if (p == 0xffC1FFBF)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(94, 124), decor_texture_arrow_up);
+				if (depth > 0) {
+					if (penetration) {
+						*penetration = depth;
+					}
+					return true;
 				}
-				else if (p == 0xff70FF96)
-				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(124, 124), decor_texture_arrow_up_right);
+			}
+		}
+		return false;
+	}
+
+	/// Walks the cells the segment passes through in order (Amanatides & Woo) and stops at the first blocked one.
+	/// Returns true if the segment is blocked. Outside the level counts as blocked. The starting cell is not
+	/// tested, so enemies sitting against a wall can still see out.
+	bool raycast(Vector2f from, Vector2f to, RayHit* hit = nullptr) const {
+		const Vector2f delta = to - from;
+		int32 x = (int32)floorf(from.x / LEVEL_SCALE);
+		int32 y = (int32)floorf(from.y / LEVEL_SCALE);
+		const int32 endX = (int32)floorf(to.x / LEVEL_SCALE);
+		const int32 endY = (int32)floorf(to.y / LEVEL_SCALE);
+		const int32 stepX = SIGN(delta.x);
+		const int32 stepY = SIGN(delta.y);
+
+		// Ray parameter in [0, 1] where the next vertical and horizontal cell borders are crossed, and between two borders
+		real32 tMaxX = stepX > 0 ? ((x + 1) * LEVEL_SCALE - from.x) / delta.x : stepX < 0 ? (x * LEVEL_SCALE - from.x) / delta.x : INFINITY;
+		real32 tMaxY = stepY > 0 ? ((y + 1) * LEVEL_SCALE - from.y) / delta.y : stepY < 0 ? (y * LEVEL_SCALE - from.y) / delta.y : INFINITY;
+		const real32 tDeltaX = stepX != 0 ? LEVEL_SCALE / fabsf(delta.x) : INFINITY;
+		const real32 tDeltaY = stepY != 0 ? LEVEL_SCALE / fabsf(delta.y) : INFINITY;
+
+		real32 t = 0;
+		while (x != endX || y != endY) {
+			if (tMaxX < tMaxY) {
+				t = tMaxX;
+				tMaxX += tDeltaX;
+				x += stepX;
+			}
+			else {
+				t = tMaxY;
+				tMaxY += tDeltaY;
+				y += stepY;
+			}
+			// Rounding can step past the end cell
+			if (t > 1) {
+				return false;
+			}
+			if (isCellBlocked(x, y)) {
+				if (hit) {
+					hit->point = from + delta * t;
+					hit->cellX = x;
+					hit->cellY = y;
 				}
-				else if (p == 0xff88FF51)
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<uint8> blockedCells;
+	// TileShape per cell, for the diagonals
+	std::vector<uint8> shapeCells;
+	bool hasShapes = false;
+	// TileKind per cell, with the tiles broken or placed since the level was loaded
+	std::vector<uint8> tileCells;
+	std::vector<uint8> originalTiles;
+	// Free cells in a row from each cell up to the next static tile in each direction, counting the cell itself.
+	// 0 on a tile. Moving solids are not in it.
+	std::vector<uint16> clearLeft;
+	std::vector<uint16> clearRight;
+	std::vector<uint16> clearUp;
+	std::vector<uint16> clearDown;
+	std::vector<LevelChunk> chunks;
+	int32 chunksX = 0;
+	int32 chunksY = 0;
+	uint32 loadedChunkCount = 0;
+	// Set once load has finished, levels after the first are loaded on a worker thread
+	std::atomic<bool> loaded = false;
+	// Broadphase for solids: the static tile in each cell (-1 for none), the moving solids are kept per chunk
+	std::vector<int32> staticSolidCells;
+	std::vector<uint32> movingSolids;
+	int32 gridWidth = 0;
+	int32 gridHeight = 0;
+	// Changes whenever blockedCells does
+	uint32 gridVersion = 0;
+};
+
+/// Level images parsed once for the whole run. A new GameState is made on every return to the main menu,
+/// its levels copy the tiles and spawners from here instead of decoding the images again. The parsed levels
+/// never change and never load chunks.
+class LevelCache
+{
+public:
+	LevelCache()
+	{
+		mutex = SDL_CreateMutex();
+	}
+
+	/// The parsed level, decoded on first use. Also called from the level loading thread.
+	const Level* get(const std::string& filename)
+	{
+		SDL_LockMutex(mutex);
+		std::unique_ptr<Level>& level = levels[filename];
+		if (!level) {
+			level = std::make_unique<Level>();
+			level->parse(filename);
+		}
+		SDL_UnlockMutex(mutex);
+		return level.get();
+	}
+
+	/// Drops a parsed level that is not loaded again, levels copied from it keep working
+	void remove(const std::string& filename)
+	{
+		SDL_LockMutex(mutex);
+		levels.erase(filename);
+		SDL_UnlockMutex(mutex);
+	}
+
+private:
+	std::unordered_map<std::string, std::unique_ptr<Level>> levels;
+	SDL_mutex* mutex = nullptr;
+};
+
+LevelCache level_cache;
+
+inline void Level::load(const std::string& levelFilename)
+{
+	const Level* parsed = level_cache.get(levelFilename);
+	if (parsed->gridWidth == 0) {
+		return;
+	}
+
+	solids.clear();
+	freeSolids.clear();
+	movingSolids.clear();
+	playerStart = parsed->playerStart;
+	keyStart = parsed->keyStart;
+	doorStart = parsed->doorStart;
+	heartStart = parsed->heartStart;
+	grampaStart = parsed->grampaStart;
+	enemySpawners = parsed->enemySpawners;
+	decorSpawners = parsed->decorSpawners;
+	diagSpawners = parsed->diagSpawners;
+	buttonSpawners = parsed->buttonSpawners;
+	width = parsed->width;
+	height = parsed->height;
+	heartTaken = false;
+	gridWidth = parsed->gridWidth;
+	gridHeight = parsed->gridHeight;
+	blockedCells = parsed->blockedCells;
+	shapeCells = parsed->shapeCells;
+	hasShapes = parsed->hasShapes;
+	tileCells = parsed->tileCells;
+	originalTiles = parsed->originalTiles;
+	clearLeft = parsed->clearLeft;
+	clearRight = parsed->clearRight;
+	clearUp = parsed->clearUp;
+	clearDown = parsed->clearDown;
+	// Unloaded, with the spawners of each chunk
+	chunks = parsed->chunks;
+	chunksX = parsed->chunksX;
+	chunksY = parsed->chunksY;
+	loadedChunkCount = 0;
+	staticSolidCells = parsed->staticSolidCells;
+	gridVersion++;
+	loaded = true;
+}
+
+// Cells kept around the camera in the flow field, the chasers that get updated are all within this
+constexpr int32 flow_field_margin_cells = 32;
+// The region moves in steps of this many cells, so following the camera does not force a rebuild every frame
+constexpr int32 flow_field_region_snap = 16;
+
+/// Breadth first search outwards from the player's cell over the tile grid, bounded to the area around
+/// the camera. Every cell stores which neighbour leads towards the player, so any number of chasers
+/// can look up their steering direction without searching themselves. The search only goes through
+/// cells where a chaser's hitbox fits, centred on the cell. Rebuilt only when the player changes cells,
+/// the region moves or tiles break.
+class FlowField
+{
+public:
+	/// chaserSize is the hitbox of the chasers in pixels
+	void update(const Level& level, Vector2f target, const Rect2f& camera, Vector2f chaserSize)
+	{
+		const int32 targetX = (int32)(target.x / LEVEL_SCALE);
+		const int32 targetY = (int32)(target.y / LEVEL_SCALE);
+		const int32 chaserWidth = MAX(1, (int32)ceilf(chaserSize.x / LEVEL_SCALE));
+		const int32 chaserHeight = MAX(1, (int32)ceilf(chaserSize.y / LEVEL_SCALE));
+
+		const auto snapDown = [](int32 cell) { return (cell / flow_field_region_snap) * flow_field_region_snap; };
+		const int32 left = MAX(0, snapDown((int32)(camera.x / LEVEL_SCALE) - flow_field_margin_cells));
+		const int32 top = MAX(0, snapDown((int32)(camera.y / LEVEL_SCALE) - flow_field_margin_cells));
+		const int32 right = MIN(level.gridWidth, snapDown((int32)((camera.x + camera.w) / LEVEL_SCALE) + flow_field_margin_cells) + flow_field_region_snap);
+		const int32 bottom = MIN(level.gridHeight, snapDown((int32)((camera.y + camera.h) / LEVEL_SCALE) + flow_field_margin_cells) + flow_field_region_snap);
+
+		if (&level == builtLevel && level.gridVersion == builtVersion && targetX == builtTargetX && targetY == builtTargetY &&
+			left == regionX && top == regionY && right - left == regionWidth && bottom - top == regionHeight &&
+			chaserWidth == chaserCellsX && chaserHeight == chaserCellsY)
+		{
+			return;
+		}
+		builtLevel = &level;
+		builtVersion = level.gridVersion;
+		builtTargetX = targetX;
+		builtTargetY = targetY;
+		regionX = left;
+		regionY = top;
+		regionWidth = MAX(0, right - left);
+		regionHeight = MAX(0, bottom - top);
+		chaserCellsX = chaserWidth;
+		chaserCellsY = chaserHeight;
+		build(level);
+	}
+
+	/// Unit direction towards the target from the cell under worldPos, false if there is no path from there
+	bool getDirection(Vector2f worldPos, Vector2f& direction) const
+	{
+		const int32 x = (int32)floorf(worldPos.x / LEVEL_SCALE) - regionX;
+		const int32 y = (int32)floorf(worldPos.y / LEVEL_SCALE) - regionY;
+		if (x < 0 || y < 0 || x >= regionWidth || y >= regionHeight)
+		{
+			return false;
+		}
+		const int8 step = flow[y * regionWidth + x];
+		if (step < 0)
+		{
+			return false;
+		}
+		direction = neighbourDirections[step];
+		return true;
+	}
+
+	inline void invalidate()
+	{
+		builtLevel = nullptr;
+	}
+
+private:
+	void build(const Level& level)
+	{
+		const int32 cellCount = regionWidth * regionHeight;
+		distance.assign(cellCount, UINT16_MAX);
+		flow.assign(cellCount, -1);
+		queue.clear();
+
+		const int32 startX = builtTargetX - regionX;
+		const int32 startY = builtTargetY - regionY;
+		if (startX < 0 || startY < 0 || startX >= regionWidth || startY >= regionHeight)
+		{
+			return;
+		}
+		buildFits(level);
+
+		// Every cell a chaser fits at while touching the target's cell is as good as the target's cell, so chasers
+		// get there even when the target is in a gap they do not fit in
+		const int32 left = getChaserLeft();
+		const int32 top = getChaserTop();
+		for (int32 y = MAX(0, startY - (chaserCellsY - 1 - top)); y <= MIN(regionHeight - 1, startY + top); ++y)
+		{
+			for (int32 x = MAX(0, startX - (chaserCellsX - 1 - left)); x <= MIN(regionWidth - 1, startX + left); ++x)
+			{
+				const int32 cell = y * regionWidth + x;
+				if (fits[cell] || cell == startY * regionWidth + startX)
 				{
-					decorSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), Vector2f(124, 124), decor_texture_arrow_down_right);
+					distance[cell] = 0;
+					queue.push_back(cell);
 				}
+			}
+		}
 
-				// Diagonal
-				else if (p == 0xff0077FF)
+		for (size_t head = 0; head < queue.size(); ++head)
+		{
+			const int32 cell = queue[head];
+			const int32 x = cell % regionWidth;
+			const int32 y = cell / regionWidth;
+			for (int8 step = 0; step < 8; ++step)
+			{
+				const int32 nx = x + neighbourOffsets[step][0];
+				const int32 ny = y + neighbourOffsets[step][1];
+				if (nx < 0 || ny < 0 || nx >= regionWidth || ny >= regionHeight ||
+					distance[ny * regionWidth + nx] != UINT16_MAX || !fits[ny * regionWidth + nx])
 				{
-					diagSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), DiagDir::TopRight);
+					continue;
 				}
-				else if (p == 0xff0067FF)
+				// No cutting corners between two tiles
+				if (neighbourOffsets[step][0] != 0 && neighbourOffsets[step][1] != 0 &&
+					(!fits[y * regionWidth + nx] || !fits[ny * regionWidth + x]))
 				{
-					diagSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), DiagDir::TopLeft);
+					continue;
 				}
-				else if (p == 0xff0057FF)
+				const int32 next = ny * regionWidth + nx;
+				distance[next] = distance[cell] + 1;
+				// The neighbour reaches the target by stepping back to this cell
+				flow[next] = (step + 4) % 8;
+				queue.push_back(next);
+			}
+		}
+	}
+
+	/// Cells of the chaser's hitbox left of and above the cell it is centred on
+	inline int32 getChaserLeft() const
+	{
+		return (chaserCellsX - 1) / 2;
+	}
+
+	inline int32 getChaserTop() const
+	{
+		return (chaserCellsY - 1) / 2;
+	}
+
+	/// Marks the region cells a chaser's hitbox fits at. Runs of free cells like the level's clearance, but over
+	/// isCellBlocked so the diagonals count too, and only over the region and the chaser's size around it.
+	void buildFits(const Level& level)
+	{
+		const int32 left = getChaserLeft();
+		const int32 top = getChaserTop();
+		const int32 rows = regionHeight + chaserCellsY - 1;
+		rowFits.assign(regionWidth * rows, 0);
+		for (int32 row = 0; row < rows; ++row)
+		{
+			const int32 y = regionY - top + row;
+			// Free cells from x to the right, enough once it reaches the chaser's width
+			int32 run = 0;
+			for (int32 x = regionX + regionWidth - 1 - left + chaserCellsX - 1; x >= regionX - left; --x)
+			{
+				run = level.isCellBlocked(x, y) ? 0 : MIN(run + 1, chaserCellsX);
+				const int32 regionCell = x + left - regionX;
+				if (regionCell < regionWidth)
 				{
-					diagSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), DiagDir::BotRight);
+					rowFits[row * regionWidth + regionCell] = run == chaserCellsX;
 				}
-				else if (p == 0xff0047FF)
+			}
+		}
+
+		// Then rows that fit in a row going up, a row at a time to stay in the cache
+		fits.assign(regionWidth * regionHeight, 0);
+		columnRuns.assign(regionWidth, 0);
+		for (int32 row = rows - 1; row >= 0; --row)
+		{
+			for (int32 x = 0; x < regionWidth; ++x)
+			{
+				uint16& run = columnRuns[x];
+				run = rowFits[row * regionWidth + x] ? (uint16)MIN(run + 1, chaserCellsY) : 0;
+				if (row < regionHeight)
 				{
-					diagSpawners.emplace_back(Vector2f(i * LEVEL_SCALE, j * LEVEL_SCALE), DiagDir::BotLeft);
+					fits[row * regionWidth + x] = run == chaserCellsY;
 				}
 			}
 		}
+	}
+
+	// Opposite directions are 4 apart
+	static constexpr int32 neighbourOffsets[8][2] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}};
+	static inline const Vector2f neighbourDirections[8] = {
+		{1, 0}, {0.7071f, 0.7071f}, {0, 1}, {-0.7071f, 0.7071f}, {-1, 0}, {-0.7071f, -0.7071f}, {0, -1}, {0.7071f, -0.7071f}
+	};
+
+	std::vector<uint16> distance;
+	std::vector<int8> flow;
+	std::vector<int32> queue;
+	// Whether the chaser fits at each region cell, and the rows and columns that led to it
+	std::vector<uint8> fits;
+	std::vector<uint8> rowFits;
+	std::vector<uint16> columnRuns;
+	int32 chaserCellsX = 1;
+	int32 chaserCellsY = 1;
+	const Level* builtLevel = nullptr;
+	uint32 builtVersion = 0;
+	int32 builtTargetX = -1;
+	int32 builtTargetY = -1;
+	int32 regionX = 0;
+	int32 regionY = 0;
+	int32 regionWidth = 0;
+	int32 regionHeight = 0;
+};
+
+// Cells per side of an ActorGrid bin
+constexpr int32 actor_grid_bin_cells = 4;
+// How far actors may have been pushed or carried since the grid was built, queries are widened by it
+constexpr real32 actor_grid_slack = LEVEL_SCALE;
+
+/// The actors moving solids push and carry, binned by their hitboxes once a frame so a solid only checks
+/// the actors around it. Stores indices into the actor list, so queries keep the list's order.
+class ActorGrid
+{
+public:
+	void build(const std::vector<Actor*>& actors, const Level& level)
+	{
+		binsX = (level.gridWidth + actor_grid_bin_cells - 1) / actor_grid_bin_cells;
+		binsY = (level.gridHeight + actor_grid_bin_cells - 1) / actor_grid_bin_cells;
+		binStarts.assign(binsX * binsY + 1, 0);
+		binned.clear();
+		for (uint32 i = 0; i < (uint32)actors.size(); ++i) {
+			const Actor* actor = actors[i];
+			if (!actor->carriedBySolids || actor->noClip || actor->isDead) {
+				continue;
+			}
+			const CellRange range = getBinRange(actor->getHitbox());
+			binned.push_back({i, range});
+			forEachBin(range, [this](int32 bin) { binStarts[bin]++; });
+		}
 
-		for (Solid& solid : solids) {
-			solid.prepare(this);
+		// Counts become bin ends, then filling backwards moves each back to its bin's start
+		for (size_t bin = 1; bin < binStarts.size(); ++bin) {
+			binStarts[bin] += binStarts[bin - 1];
+		}
+		entries.resize(binStarts.back());
+		for (auto it = binned.rbegin(); it != binned.rend(); ++it) {
+			const uint32 actor = it->actor;
+			forEachBin(it->range, [this, actor](int32 bin) { entries[--binStarts[bin]] = actor; });
 		}
 	}
 
-	bool checkSolid(const Vector2f& pos) {
-		if (pos.x < 0 || pos.x >= width || pos.y < 0 || pos.y >= height) {
-			return true;
+	/// Indices of the actors binned around the rect, in actor list order
+	void query(const Rect2f& rect, FrameVector<uint32>& found) const
+	{
+		if (binsX == 0) {
+			return;
+		}
+		forEachBin(getBinRange(rect), [this, &found](int32 bin) {
+			found.insert(found.end(), entries.begin() + binStarts[bin], entries.begin() + binStarts[bin + 1]);
+		});
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+	}
+
+private:
+	struct BinnedActor
+	{
+		uint32 actor;
+		CellRange range;
+	};
+
+	/// Bins touched by a rect, clamped to the grid so actors outside the level land in the edge bins
+	CellRange getBinRange(const Rect2f& rect) const
+	{
+		const real32 binSize = LEVEL_SCALE * actor_grid_bin_cells;
+		CellRange range;
+		range.left = MIN(MAX((int32)floorf(rect.x / binSize), 0), binsX - 1);
+		range.top = MIN(MAX((int32)floorf(rect.y / binSize), 0), binsY - 1);
+		range.right = MIN(MAX((int32)floorf((rect.x + rect.w) / binSize), 0), binsX - 1);
+		range.bottom = MIN(MAX((int32)floorf((rect.y + rect.h) / binSize), 0), binsY - 1);
+		return range;
+	}
+
+	template <typename F>
+	void forEachBin(const CellRange& range, F&& f) const
+	{
+		for (int32 y = range.top; y <= range.bottom; ++y) {
+			for (int32 x = range.left; x <= range.right; ++x) {
+				f(y * binsX + x);
+			}
 		}
-		return solidMap.find(pos) != solidMap.end();
 	}
+
+	int32 binsX = 0;
+	int32 binsY = 0;
+	// Start of each bin in entries, plus the end of the last one
+	std::vector<uint32> binStarts;
+	std::vector<uint32> entries;
+	std::vector<BinnedActor> binned;
 };
 
+constexpr const char* level_filenames[4] = {"level1.png", "level2.png", "level3.png", "level4.png"};
+
 struct GameState
 {
 	std::vector<Actor*> AllActors;
@@ -1620,23 +3261,29 @@ struct GameState
 	Door door;
 	Heart heart;
 	Grampa grampa;
-	std::vector<std::unique_ptr<Enemy>> enemies;
-	std::vector<std::unique_ptr<Decor>> decors;
-	std::vector<std::unique_ptr<Diagonal>> diagonals;
-	std::vector<std::unique_ptr<Button>> buttons;
-
-	std::vector<std::unique_ptr<Enemy>> newEnemiesQueue;
+	// Owns the memory of the actors below, so it is declared first and destroyed last
+	LevelArena levelArena;
+	std::vector<LevelPtr<Enemy>> enemies;
+	std::vector<LevelPtr<Decor>> decors;
+	std::vector<LevelPtr<Diagonal>> diagonals;
+	std::vector<LevelPtr<Button>> buttons;
+
+	std::vector<LevelPtr<Enemy>> newEnemiesQueue;
 	Level* currentLevel;
 	Level levels[4];
+	FlowField flowField;
+	ActorGrid solidActors;
 	State current_state = MainMenu;
 	Rect2f camera = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+	// Added to every screen position while the screen shakes
+	Vector2f screenShake = {0, 0};
 
 	uint32 dead_frames = 0;
 	uint32 controls_frames = 0;
 	uint32 playing_frames = 0;
 	uint32 gameover_frames = 0;
 	uint32 shaking_frames = 0;
-	uint32 main_menu_frames = 0;
+	real32 main_menu_time = 0;
 	uint32 beginning_frames = 0;
 	uint32 victory_frames = 0;
 	real32 boss_entrance_time = 0;
@@ -1647,17 +3294,18 @@ struct GameState
 	real64 play_time_passed = 0;
 	bool heartPopped = false;
 	bool bossStarted = false;
-	EnemyBoss* boss;
+	EnemyBoss* boss = nullptr;
 
 	void reset()
 	{
+		waitForLevel(*currentLevel);
 		heartPopped = false;
 
-		player.setTexture(player_texture_normal_idle, TextureType::Idle);
-		player.setTexture(player_texture_normal_swim, TextureType::Swim);
 		player.hitRect = player.hitRects[0];
 		player.width = player.normalSize.x;
 		player.height = player.normalSize.y;
+		player.setTexture(player_texture_normal_idle, TextureType::Idle);
+		player.setTexture(player_texture_normal_swim, TextureType::Swim);
 		player.position = currentLevel->playerStart;
 		player.velocity = { 0, 0 };
 		player.visible = true;
@@ -1672,10 +3320,19 @@ struct GameState
 		bossStarted = false;
 		boss_brick_state = 0;
 		boss_entrance_time = 0;
+		for (Level& level : levels) {
+			// Levels still loading in the background have nothing to unload
+			if (&level != currentLevel && level.loaded) {
+				level.unloadAllChunks();
+			}
+		}
 		if (currentLevel == levels + 3) {
-			levels[3] = Level();
-			levels[3].load("level4.png");
+			// The boss walls and broken blocks go away
+			levels[3].restoreTiles();
+			levels[3].heartTaken = false;
 		}
+		flowField.invalidate();
+		clearParticles();
 
 		key.setStartPos(currentLevel->keyStart);
 		if (currentLevel->keyStart.isZero()) {
@@ -1701,66 +3358,278 @@ struct GameState
 		decors.clear();
 		diagonals.clear();
 		buttons.clear();
+		newEnemiesQueue.clear();
 		AllActors.clear();
-		//todo replace breakable blocks?
+		boss = nullptr;
+		LogInfo("Level arena: %zu KB used, %zu KB reserved", levelArena.getUsedBytes() / 1024, levelArena.getCapacity() / 1024);
+		if (levelArena.getLiveObjects() > 0) {
+			LogError("%zu level objects outlived the level", levelArena.getLiveObjects());
+		}
+		levelArena.release();
+
+		// Decors, diagonals, enemies and tiles come with their chunks, everything starts over
+		currentLevel->unloadAllChunks();
+		for (EnemySpawner& spawner : currentLevel->enemySpawners) {
+			spawner.chunk = currentLevel->getChunkIndex(
+				MIN((int32)(spawner.spawnPoint.x / LEVEL_SCALE), currentLevel->gridWidth - 1),
+				MIN((int32)(spawner.spawnPoint.y / LEVEL_SCALE), currentLevel->gridHeight - 1));
+			spawner.alive = false;
+			spawner.defeated = false;
+			spawner.hasSavedState = false;
+			spawner.savedPosition = {0, 0};
+			spawner.savedHealth = 0;
+		}
 
 		for (ButtonSpawner& spawner : currentLevel->buttonSpawners) {
-			buttons.push_back(std::make_unique<Button>(spawner.spawnPoint, spawner.isInverted));
+			buttons.push_back(levelArena.make<Button>(spawner.spawnPoint, spawner.isInverted));
 			AllActors.push_back(buttons[buttons.size()-1].get());
 		}
 		
-		for (DecorSpawner& spawner : currentLevel->decorSpawners) {
-			decors.push_back(std::make_unique<Decor>(spawner.spawnPoint, spawner.size, spawner.texture));
-			AllActors.push_back(decors[decors.size()-1].get());
+		AllActors.push_back(&key);
+		AllActors.push_back(&door);
+		AllActors.push_back(&player);
+		AllActors.push_back(&heart);
+		AllActors.push_back(&grampa);
+
+		// The player must not take a step before the tiles around it exist
+		const Vector2f playerCenter = player.getCenter();
+		streamChunks({playerCenter.x - camera.w / 2, playerCenter.y - camera.h / 2, camera.w, camera.h}, true);
+	}
+
+	/// Moves the platforms, binning the actors first so each one only pushes and carries the actors near it
+	void updateMovingSolids(real32 time_delta)
+	{
+		if (currentLevel->movingSolids.empty()) {
+			return;
 		}
-		
-		for (DiagSpawner& spawner : currentLevel->diagSpawners) {
-			diagonals.push_back(std::make_unique<Diagonal>(spawner.spawnPoint, spawner.direction));
-			AllActors.push_back(diagonals[diagonals.size()-1].get());
+		solidActors.build(AllActors, *currentLevel);
+		currentLevel->updateMovingSolids(time_delta);
+	}
+
+	/// Loads the chunks around the view and unloads the farthest ones once more than level_chunk_budget are loaded.
+	/// Chunks under the view load right away, the ones in the margin a few per frame unless loadAll is set.
+	void streamChunks(const Rect2f& view, bool loadAll = false)
+	{
+		Level* level = currentLevel;
+		const CellRange visible = level->getChunkRange(view);
+		const Rect2f ahead = {view.x - level_stream_margin, view.y - level_stream_margin,
+		                      view.w + 2 * level_stream_margin, view.h + 2 * level_stream_margin};
+		const CellRange wanted = level->getChunkRange(ahead);
+
+		int32 loads = 0;
+		for (int32 y = wanted.top; y <= wanted.bottom; ++y) {
+			for (int32 x = wanted.left; x <= wanted.right; ++x) {
+				const uint32 chunk = y * level->chunksX + x;
+				if (level->chunks[chunk].loaded) {
+					continue;
+				}
+				const bool isVisible = x >= visible.left && x <= visible.right && y >= visible.top && y <= visible.bottom;
+				if (isVisible || loadAll || loads < level_chunk_loads_per_frame) {
+					loadChunk(chunk);
+					loads += isVisible ? 0 : 1;
+				}
+			}
 		}
 
-		for (EnemySpawner& spawner : currentLevel->enemySpawners) {
-			std::unique_ptr<Enemy> newEnemy;
-			switch (spawner.enemyType)
-			{
-			case EnemyType::Fish:
-				newEnemy = std::make_unique<EnemyFish>(spawner.spawnPoint);
-				break;
-			case EnemyType::Shrimp:
-				newEnemy = std::make_unique<EnemyShrimp>(spawner.spawnPoint, false);
-				break;
-			case EnemyType::Jellyfish:
-				newEnemy = std::make_unique<EnemyJelly>(spawner.spawnPoint);
-				break;
-			case EnemyType::ShrimpInverted:
-				newEnemy = std::make_unique<EnemyShrimp>(spawner.spawnPoint, true);
-				break;
-			default:
-				newEnemy = std::make_unique<EnemyBoss>(spawner.spawnPoint);
-				boss = (EnemyBoss*)newEnemy.get();
+		const Vector2f viewCenter = view.getCenter();
+		while (level->loadedChunkCount > level_chunk_budget) {
+			int32 farthest = -1;
+			real32 farthestDistance = 0;
+			for (int32 chunk = 0; chunk < (int32)level->chunks.size(); ++chunk) {
+				const int32 x = chunk % level->chunksX;
+				const int32 y = chunk / level->chunksX;
+				if (!level->chunks[chunk].loaded || (x >= wanted.left && x <= wanted.right && y >= wanted.top && y <= wanted.bottom)) {
+					continue;
+				}
+				const real32 distance = (level->getChunkRect(chunk).getCenter() - viewCenter).getMagnitude();
+				if (distance > farthestDistance) {
+					farthestDistance = distance;
+					farthest = chunk;
+				}
+			}
+			if (farthest < 0) {
 				break;
 			}
-			enemies.push_back(std::move(newEnemy));
- 			AllActors.push_back(enemies[enemies.size()-1].get());
+			unloadChunk(farthest);
 		}
-		
-		AllActors.push_back(&key);
-		AllActors.push_back(&door);
-		AllActors.push_back(&player);
-		AllActors.push_back(&heart);
-		AllActors.push_back(&grampa);
+	}
+
+	void loadChunk(uint32 index)
+	{
+		Level* level = currentLevel;
+		level->loadChunk(index);
+		const LevelChunk& chunk = level->chunks[index];
+
+		// Buttons, then decors, then diagonals, each in spawner order, so they are drawn behind everything else
+		// and layered as in the level image
+		for (const uint32 i : chunk.decorSpawners) {
+			const DecorSpawner& spawner = level->decorSpawners[i];
+			insertStreamed(decors, levelArena.make<Decor>(spawner.spawnPoint, spawner.size, spawner.texture), index, i,
+			               buttons.size());
+		}
+		for (const uint32 i : chunk.diagSpawners) {
+			const DiagSpawner& spawner = level->diagSpawners[i];
+			insertStreamed(diagonals, levelArena.make<Diagonal>(spawner.spawnPoint, spawner.direction), index, i,
+			               buttons.size() + decors.size());
+		}
+
+		for (uint32 i = 0; i < level->enemySpawners.size(); ++i) {
+			const EnemySpawner& spawner = level->enemySpawners[i];
+			if (spawner.chunk == index && !spawner.alive && !spawner.defeated) {
+				spawnEnemy(i);
+			}
+		}
+	}
+
+	void spawnEnemy(uint32 spawnerIndex)
+	{
+		EnemySpawner& spawner = currentLevel->enemySpawners[spawnerIndex];
+		LevelPtr<Enemy> newEnemy;
+		switch (spawner.enemyType)
+		{
+		case EnemyType::Fish:
+			newEnemy = levelArena.make<EnemyFish>(spawner.spawnPoint);
+			break;
+		case EnemyType::Shrimp:
+			newEnemy = levelArena.make<EnemyShrimp>(spawner.spawnPoint, false);
+			break;
+		case EnemyType::Jellyfish:
+			newEnemy = levelArena.make<EnemyJelly>(spawner.spawnPoint);
+			break;
+		case EnemyType::ShrimpInverted:
+			newEnemy = levelArena.make<EnemyShrimp>(spawner.spawnPoint, true);
+			break;
+		default:
+			newEnemy = levelArena.make<EnemyBoss>(spawner.spawnPoint);
+			boss = (EnemyBoss*)newEnemy.get();
+			break;
+		}
+		if (spawner.hasSavedState) {
+			newEnemy->position = spawner.savedPosition;
+			newEnemy->health = spawner.savedHealth;
+		}
+		newEnemy->spawnerIndex = spawnerIndex;
+		spawner.alive = true;
+
+		// Enemies are drawn before the key, the door and the player
+		AllActors.insert(std::find(AllActors.begin(), AllActors.end(), (Actor*)&key), newEnemy.get());
+		enemies.push_back(std::move(newEnemy));
+	}
+
+	/// Saves the enemies that are in the chunk into their spawners and removes them with the chunk's decors and diagonals
+	void unloadChunk(uint32 index)
+	{
+		Level* level = currentLevel;
+		const Rect2f chunkRect = level->getChunkRect(index);
+
+		FrameVector<Enemy*> leaving(FrameAllocator<Enemy*>("chunk unload"));
+		for (auto& enemy : enemies) {
+			// The boss stays for the whole fight
+			if (enemy.get() != boss && chunkRect.contains(enemy->getCenter())) {
+				leaving.push_back(enemy.get());
+			}
+		}
+		// Bubbles would be left with a creator that does not exist anymore
+		for (auto& enemy : enemies) {
+			EnemyBubble* bubble = dynamic_cast<EnemyBubble*>(enemy.get());
+			if (bubble && std::find(leaving.begin(), leaving.end(), bubble->creator) != leaving.end() &&
+			    std::find(leaving.begin(), leaving.end(), enemy.get()) == leaving.end()) {
+				leaving.push_back(bubble);
+			}
+		}
+
+		for (Enemy* enemy : leaving) {
+			if (enemy->spawnerIndex >= 0) {
+				EnemySpawner& spawner = level->enemySpawners[enemy->spawnerIndex];
+				spawner.alive = false;
+				if (enemy->isDying()) {
+					spawner.defeated = true;
+				}
+				else {
+					spawner.hasSavedState = true;
+					spawner.savedPosition = enemy->position;
+					spawner.savedHealth = enemy->health;
+					spawner.chunk = index;
+				}
+			}
+			deleteFromVector(AllActors, (Actor*)enemy);
+			for (size_t i = 0; i < enemies.size(); ++i) {
+				if (enemies[i].get() == enemy) {
+					enemies.erase(enemies.begin() + i);
+					break;
+				}
+			}
+		}
+
+		despawnStreamed(decors, index);
+		despawnStreamed(diagonals, index);
+		level->unloadChunk(index);
+	}
+
+	/// Keeps actors sorted by spawner, and AllActors in the same order from firstActor on
+	template <typename T>
+	void insertStreamed(std::vector<LevelPtr<T>>& actors, LevelPtr<T> actor, uint32 chunk, uint32 spawner, size_t firstActor)
+	{
+		actor->streamChunk = (int32)chunk;
+		actor->streamSpawner = (int32)spawner;
+		const auto it = std::upper_bound(actors.begin(), actors.end(), actor->streamSpawner,
+		                                 [](int32 value, const LevelPtr<T>& other) { return value < other->streamSpawner; });
+		AllActors.insert(AllActors.begin() + firstActor + (it - actors.begin()), actor.get());
+		actors.insert(it, std::move(actor));
+	}
+
+	template <typename T>
+	void despawnStreamed(std::vector<LevelPtr<T>>& actors, uint32 chunk)
+	{
+		for (int32 i = (int32)actors.size() - 1; i >= 0; --i) {
+			if (actors[i]->streamChunk == (int32)chunk) {
+				deleteFromVector(AllActors, (Actor*)actors[i].get());
+				actors.erase(actors.begin() + i);
+			}
+		}
+	}
+
+	/// Waits for the background loader if it has not finished this level yet
+	void waitForLevel(const Level& level)
+	{
+		if (!level.loaded && levelLoader) {
+			SDL_WaitThread(levelLoader, NULL);
+			levelLoader = nullptr;
+		}
+	}
+
+	static int loadLevelsInBackground(void* data)
+	{
+		GameState* game = (GameState*)data;
+		for (int32 i = 1; i < 4; ++i) {
+			game->levels[i].load(level_filenames[i]);
+		}
+		return 0;
 	}
 
 	GameState()
 	{
-		levels[0].load("level1.png");
-		levels[1].load("level2.png");
-		levels[2].load("level3.png");
-		levels[3].load("level4.png");
+		// Only the first level is needed to start, the rest are read while it is played
+		levels[0].load(level_filenames[0]);
+#ifndef __EMSCRIPTEN__
+		levelLoader = SDL_CreateThread(loadLevelsInBackground, "levels", this);
+#endif
+		if (!levelLoader) {
+			loadLevelsInBackground(this);
+		}
 
 		currentLevel = &levels[0];
 		reset();
 	}
+
+	~GameState()
+	{
+		if (levelLoader) {
+			SDL_WaitThread(levelLoader, NULL);
+		}
+	}
+
+	SDL_Thread* levelLoader = nullptr;
 };
 
 extern GameState* state;
@@ -1769,6 +3638,14 @@ void Enemy::die() {
 	Actor::die();
 }
 
+void EnemyBubble::die() {
+	if (!isDead) {
+		const Rect2f hitbox = getHitbox();
+		emitBubblePop(hitbox.getCenter(), hitbox.w / 2);
+	}
+	Enemy::die();
+}
+
 void Player::die() {
 	Actor::die();
 
@@ -1895,35 +3772,10 @@ void Actor::update(real32 time_delta, const ControllerInput* input)
 	}
 
 	// Set animation frame
-	if (puffingFrames != 0) {
-
-	}
-	else {
-		real32 animationDelay;
-		if (velocityMag > 0 && textures.contains(TextureType::Swim))
-		{
-			currentTexture = &textures[TextureType::Swim];
-			animationDelay = movingAnimationDelay;
-		}
-		else
-		{
-			currentTexture = &textures[TextureType::Idle];
-			animationDelay = idleAnimationDelay;
-		}
-		
-		// Animation
-		uint32 totalFrames = currentTexture->size.x / width;
-		currentFrame = (currentFrame) % totalFrames;
-		if (currentFrame == 0 && dynamic_cast<EnemyJelly*>(this)) {
-			animationDelay = 2.5f;
-		}
-
-		if (state->play_time_passed - lastAnimationTime > animationDelay)
-		{
-			lastAnimationTime = state->play_time_passed;
-			uint32 totalFrames = currentTexture->size.x / width;
-			currentFrame = (currentFrame + 1) % totalFrames;
-		}
+	if (puffingFrames == 0) {
+		const AnimationClip* swimClip = clips[(size_t)TextureType::Swim];
+		animation.setClip(velocityMag > 0 && swimClip ? swimClip : clips[(size_t)TextureType::Idle]);
+		animation.step(state->play_time_passed);
 	}
 
 	// Apply velocity
@@ -1953,43 +3805,82 @@ void Actor::update(real32 time_delta, const ControllerInput* input)
 	});
 }
 
-inline const Solid* Actor::collideAt(const std::vector<Solid>& solids, Vector2f position) const
+inline const Solid* Actor::collideAt(const Level* level, Vector2f position) const
 {
-	Rect2f hitbox = getHitbox(position);
-	for (const Solid& solid : solids)
+	const Solid* solid = level->findSolid(getHitbox(position));
+	if (solid)
 	{
-		if (solid.collidable)
-		{
-			const Rect2f solid_rect = {solid.position.x, solid.position.y, solid.width, solid.height};
-			if (hitbox.collides(solid_rect))
-			{
-				LogWarn("Collided with solid in position %f, %f", position.x, position.y);
-				return &solid;
-			}
+		LogWarn("Collided with solid in position %f, %f", position.x, position.y);
+	}
+	return solid;
+}
+
+// Slopes turn velocity into the surface like the old diagonals did: sliding along it, or bouncing off while puffed
+void Actor::onSlopeContact(Vector2f normal)
+{
+	if (dot(velocity, normal) >= 0) {
+		return;
+	}
+	if (isPuffed || puffingFrames > 0) {
+		// Nearly axis aligned hits bounce straight off the diagonal
+		const real32 absX = abs(velocity.x);
+		const real32 absY = abs(velocity.y);
+		if (absY != 0 && absX / absY > 4) {
+			velocity.y = 0;
+		}
+		else if (absX != 0 && absY / absX > 4) {
+			velocity.x = 0;
 		}
+		velocity -= normal * (2 * dot(velocity, normal));
+	}
+	else {
+		velocity -= normal * dot(velocity, normal);
 	}
-	return nullptr;
 }
 
-inline bool handleCollision(Vector2f position, std::function<void()> on_collide, int& move, int sign, Actor* actor, real32& coord) {
-	const Solid * solid = actor->collideAt(state->currentLevel->solids, position);
+inline bool handleCollision(Vector2f position, CollisionCallback on_collide, int& move, int sign, Actor* actor, real32& coord) {
+	Level* level = state->currentLevel;
+	const Solid * solid = actor->collideAt(level, position);
 	bool comingToBreak = false;
 	if (solid) {
 		comingToBreak = (actor->isPuffed || actor->puffingFrames > 0) && actor->velocity.getMagnitude() > 1200;
 	}
-	if (!solid || (solid->breakable && comingToBreak) || actor->noClip)
+
+	Vector2f slopeNormal;
+	const bool shapeHit = !solid && !actor->noClip && level->collideShapes(actor->getHitbox(position), &slopeNormal);
+	if (shapeHit && !slopeNormal.isZero()) {
+		// Slide: take the step together with one pixel along the other axis, away from the slope
+		const bool horizontal = position.x != actor->position.x;
+		const Vector2f slide = horizontal ? Vector2f(0, (real32)SIGN(slopeNormal.y)) : Vector2f((real32)SIGN(slopeNormal.x), 0);
+		Vector2f unused;
+		if (!actor->collideAt(level, position + slide) && !level->collideShapes(actor->getHitbox(position + slide), &unused)) {
+			actor->position += slide;
+			coord += sign;
+			move -= sign;
+			actor->onSlopeContact(slopeNormal);
+			return false;
+		}
+	}
+
+	if (shapeHit && actor->pushOutOfShapes()) {
+		// Already inside a shape before the step, it was moved out instead
+		return true;
+	}
+
+	if ((!solid && !shapeHit) || (solid && solid->breakable && comingToBreak) || actor->noClip)
 	{
 		coord += sign;
 		move -= sign;
 
 		if (solid && solid->breakable && comingToBreak) {
-			deleteFromVector(state->currentLevel->solids, *solid);
+			emitBlockDebris(solid->getRect(), actor->velocity);
+			level->breakSolid(solid);
 			playSound(block_break);
 		}
 	}
 	else
 	{
-		if (on_collide != nullptr)
+		if (on_collide)
 		{
 			on_collide();
 		}
@@ -1998,7 +3889,7 @@ inline bool handleCollision(Vector2f position, std::function<void()> on_collide,
 	return false;
 }
 
-inline void Actor::moveX(real32 amount, std::function<void()> on_collide)
+inline void Actor::moveX(real32 amount, CollisionCallback on_collide)
 {
 	//LogError("Actor moveX CALLED with amount: %f", amount);
 	xRemainder += amount;
@@ -2017,7 +3908,7 @@ inline void Actor::moveX(real32 amount, std::function<void()> on_collide)
 	}
 }
 
-inline void Actor::moveY(real32 amount, std::function<void()> on_collide)
+inline void Actor::moveY(real32 amount, CollisionCallback on_collide)
 {
 	//LogError("Actor moveY CALLED with amount: %f", amount);
 	yRemainder += amount;
@@ -2036,7 +3927,7 @@ inline void Actor::moveY(real32 amount, std::function<void()> on_collide)
 	}
 }
 
-inline Vector2f checkCollision(const std::vector<Solid>& solids, const Rect2f& hitbox)
+inline Vector2f checkCollision(const Level* level, const Rect2f& hitbox)
 {
 	// Check out of bounds
 	if (hitbox.x < 0){
@@ -2052,19 +3943,59 @@ inline Vector2f checkCollision(const std::vector<Solid>& solids, const Rect2f& h
 		return {0, state->currentLevel->height - hitbox.y - hitbox.h};
 	}
 
-	// Check solids
-    for (const Solid& solid : solids)
-    {
-        if (solid.collidable)
-        {
-            const Rect2f solid_rect = {solid.position.x, solid.position.y, solid.width, solid.height};
-            if (hitbox.collides(solid_rect))
-            {
-                return hitbox.collisionDepth(solid_rect);
-            }
-        }
-    }
-    return {0, 0};
+	// Tiles come from the clearance runs. With a moving solid in the way the broadphase decides which solid
+	// is hit first, as it always did.
+	if (const Solid* moving = level->findMovingSolid(hitbox)) {
+		const Solid* first = level->findSolid(hitbox);
+		return hitbox.collisionDepth((first ? first : moving)->getRect());
+	}
+	const int32 tile = level->findStaticTile(hitbox);
+	if (tile >= 0) {
+		return hitbox.collisionDepth(level->getCellRect(tile));
+	}
+
+	// Full cells behind a slope are static tiles, only the slopes are left. The way out is along the normal,
+	// half the penetration on each axis, and like collisionDepth the depth points into the slope.
+	Vector2f slopeNormal;
+	real32 penetration = 0;
+	if (level->collideShapes(hitbox, &slopeNormal, &penetration)) {
+		const real32 half = ceilf(penetration / 2);
+		return {-(real32)SIGN(slopeNormal.x) * half, -(real32)SIGN(slopeNormal.y) * half};
+	}
+	return {0, 0};
+}
+
+// Growing hitboxes can end up inside a slope, which moveX and moveY only ever step out of one pixel at a time.
+// Takes the shortest way out: along the normal of the slope, or straight along an axis when that is shorter.
+bool Actor::pushOutOfShapes()
+{
+	const Level* level = state->currentLevel;
+	Vector2f slopeNormal;
+	if (noClip || !level->collideShapes(getHitbox(), &slopeNormal)) {
+		return false;
+	}
+	const Vector2f directions[] = {
+		{(real32)SIGN(slopeNormal.x), (real32)SIGN(slopeNormal.y)},
+		{1, 1}, {-1, 1}, {1, -1}, {-1, -1},
+		{1, 0}, {-1, 0}, {0, 1}, {0, -1}
+	};
+	constexpr int32 max_push = diagonal_cells * (int32)LEVEL_SCALE;
+	for (int32 distance = 1; distance <= max_push; ++distance) {
+		for (const Vector2f& direction : directions) {
+			if (direction.isZero()) {
+				continue;
+			}
+			const Vector2f target = position + direction * (real32)distance;
+			if (!checkCollision(level, getHitbox(target))) {
+				position = target;
+				if (!slopeNormal.isZero()) {
+					onSlopeContact(slopeNormal);
+				}
+				return true;
+			}
+		}
+	}
+	return false;
 }
 
 void Player::puffUp()
@@ -2086,7 +4017,7 @@ void Player::puffUp()
 		height = puffedSize.y;
 		setTexture(player_texture_puffing, TextureType::Idle);
 		setTexture(player_texture_puffing, TextureType::Swim);
-		currentFrame = 0;
+		animation.frame = 0;
 
 		if (!this->tryHitRectChange(-puffOffset, hitRects[1])) {
 			puffingFrames = -1;
@@ -2118,6 +4049,24 @@ bool Player::tryHitRectChange(Vector2f deltaPos, const Rect2f& newHitRect) {
         ceil(abs(totalSizeChange.y) / 30.f)
     });
 
+	// Every step lies between the current and the final hitbox. When nothing is in the box around both,
+	// no step can collide and the change is applied at once.
+	const Level* level = state->currentLevel;
+	const Rect2f currentHitBox = getHitbox();
+	const Rect2f finalHitBox = {position.x + deltaPos.x + newHitRect.x, position.y + deltaPos.y + newHitRect.y, newHitRect.w, newHitRect.h};
+	const real32 areaLeft = MIN(currentHitBox.x, finalHitBox.x);
+	const real32 areaTop = MIN(currentHitBox.y, finalHitBox.y);
+	Vector2f areaNormal;
+	const Rect2f area = {areaLeft, areaTop,
+	                     MAX(currentHitBox.x + currentHitBox.w, finalHitBox.x + finalHitBox.w) - areaLeft,
+	                     MAX(currentHitBox.y + currentHitBox.h, finalHitBox.y + finalHitBox.h) - areaTop};
+	if (area.x >= 0 && area.y >= 0 && area.x + area.w <= level->width && area.y + area.h <= level->height &&
+		level->findStaticTile(area) < 0 && !level->findMovingSolid(area) && !level->collideShapes(area, &areaNormal)) {
+		position += deltaPos;
+		hitRect = newHitRect;
+		return true;
+	}
+
     // Define the step increments
     Vector2f stepDeltaPos = deltaPos / float(steps);
     Vector2f stepOffsetChange = offsetChange / float(steps);
@@ -2139,16 +4088,15 @@ bool Player::tryHitRectChange(Vector2f deltaPos, const Rect2f& newHitRect) {
             stepHitRect.h
         };
 
-        std::vector<Solid>& solids = state->currentLevel->solids;
-
-        Vector2f leftCollision = checkCollision(solids, {targetHitBox.x, targetHitBox.y, 1, targetHitBox.h});
-        Vector2f rightCollision = checkCollision(solids, {targetHitBox.x + targetHitBox.w - 1, targetHitBox.y, 1, targetHitBox.h});
-        Vector2f topCollision = checkCollision(solids, {targetHitBox.x, targetHitBox.y, targetHitBox.w, 1});
-        Vector2f bottomCollision = checkCollision(solids, {targetHitBox.x, targetHitBox.y + targetHitBox.h - 1, targetHitBox.w, 1});
+        Vector2f leftCollision = checkCollision(level, {targetHitBox.x, targetHitBox.y, 1, targetHitBox.h});
+        Vector2f rightCollision = checkCollision(level, {targetHitBox.x + targetHitBox.w - 1, targetHitBox.y, 1, targetHitBox.h});
+        Vector2f topCollision = checkCollision(level, {targetHitBox.x, targetHitBox.y, targetHitBox.w, 1});
+        Vector2f bottomCollision = checkCollision(level, {targetHitBox.x, targetHitBox.y + targetHitBox.h - 1, targetHitBox.w, 1});
 
         if (leftCollision && rightCollision && topCollision && bottomCollision) {
             // Stop inflating if collisions on opposite sides
 			position = orgPosition + deltaPos; // position will be taken back in deflation
+			pushOutOfShapes();
             return false;
         } else {
             // Apply movement if there's a collision on one side but space on the other
@@ -2188,6 +4136,8 @@ bool Player::tryHitRectChange(Vector2f deltaPos, const Rect2f& newHitRect) {
         }
     }
 
+	// The side pushes leave part of a step inside a slope when the step is bigger than the push
+	pushOutOfShapes();
     return true;
 }
 
@@ -2226,6 +4176,23 @@ void EnemyFish::chase(Vector2f target, ControllerInput& input)
 	}
 }
 
+// Follows the shared flow field around tiles, and goes straight for the player once close or off the field
+void EnemyFish::chasePlayer(ControllerInput& input)
+{
+	const Vector2f center = getCenter();
+	Vector2f direction;
+	if ((state->player.getCenter() - center).getMagnitude() < 4 * LEVEL_SCALE || !state->flowField.getDirection(center, direction)) {
+		chase(state->player.position, input);
+		return;
+	}
+
+	const real32 threshold = 0.38f;
+	input.dir_right = direction.x > threshold;
+	input.dir_left = direction.x < -threshold;
+	input.dir_down = direction.y > threshold;
+	input.dir_up = direction.y < -threshold;
+}
+
 inline void EnemyFish::render(SDL_Renderer* renderer)
 {
 	Actor::render(renderer);
@@ -2244,11 +4211,9 @@ inline void EnemyShrimp::render(SDL_Renderer* renderer)
 			}
 		}
 
-		const SDL_Rect main_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-		const SDL_Rect claw_sprite_rect = {static_cast<int>(currentClawFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
 		const SDL_FRect dest_rect = {position.x, position.y, width, height};
-		renderTextureEx(renderer, currentTexture->texture, &main_sprite_rect, &dest_rect, 0, NULL, flip);
-		renderTextureEx(renderer, currentClawTexture, &claw_sprite_rect, &dest_rect, drawAngle, &claw_offset, flip);
+		renderTextureEx(renderer, animation.getTexture(), animation.getRect(), &dest_rect, 0, NULL, flip);
+		renderTextureEx(renderer, clawAnimation.getTexture(), clawAnimation.getRect(), &dest_rect, drawAngle, &claw_offset, flip);
 	}
 }
 
@@ -2303,7 +4268,8 @@ void EnemyFish::think(real32 time_delta)
 		chasingPlayer = false;
 		const real32 distToPlayer = (state->player.position - position).getMagnitude();
 		const real32 seeDistance = seesPlayer ? 1800 : 900;
-		if (distToPlayer < seeDistance)
+		// Noticing the player needs a clear line, once chasing the flow field leads around the tiles
+		if (distToPlayer < seeDistance && (seesPlayer || playerInSight))
 		{
 			if (!seesPlayer) {
 				// Just saw the player
@@ -2329,7 +4295,7 @@ void EnemyFish::think(real32 time_delta)
 				}
 				else {
 					chasingPlayer = true;
-					chase(state->player.position, input);
+					chasePlayer(input);
 				}
 			}
 		}
@@ -2392,32 +4358,19 @@ void EnemyShrimp::update(real32 time_delta, const ControllerInput* input)
 		if (shootCooldown > 0) {
 			shootCooldown = MAX(shootCooldown - time_delta, 0);
 		}
-		else if (input->button_b && currentClawFrame == 4) {
+		else if (input->button_b && clawAnimation.frame == 4) {
 			// Shoot a bubble
 			const Vector2f targetVector = state->player.getCenter() - getCenter();
 			Vector2f clawPos = {claw_offset.x, claw_offset.y};
-			state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(position + clawPos, targetVector.getNormalized(), this));
+			state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(position + clawPos, targetVector.getNormalized(), this));
 			shootCooldown = shootPeriod;
 			playSound(shoot);
 		}
 	}
 
 	// Claw animation
-	real32 clawAnimationDelay;
-	currentClawTexture = targetingPlayer ? textureClawAttack : textureClaw;
-	currentClawTextureSize = targetingPlayer ? textureClawAttackSize : textureClawSize;
-	
-	clawAnimationDelay = 0.3f;
-	
-	// Animation
-	uint32 totalFrames = currentClawTextureSize.x / width;
-	currentClawFrame = (currentClawFrame) % totalFrames;
-	if (state->play_time_passed - lastClawAnimationTime > clawAnimationDelay)
-	{
-		lastClawAnimationTime = state->play_time_passed;
-		uint32 totalFrames = currentClawTextureSize.x / width;
-		currentClawFrame = (currentClawFrame + 1) % totalFrames;
-	}
+	clawAnimation.setClip(targetingPlayer ? clawAttackClip : clawClip);
+	clawAnimation.step(state->play_time_passed);
 }
 
 void EnemyBubble::update(real32 time_delta, const ControllerInput* input)
@@ -2481,7 +4434,7 @@ void EnemyShrimp::think(real32 time_delta)
 		const Vector2f targetVector = state->player.getCenter() - getCenter();
 		const real32 distToPlayer = targetVector.getMagnitude();
 		const real32 seeDistance = targetingPlayer ? 1600 : 800;
-		if (distToPlayer < seeDistance) {
+		if (distToPlayer < seeDistance && playerInSight) {
 			if (!targetingPlayer) {
 				targetingPlayer = true;
 				vigilant = true;
@@ -2515,6 +4468,95 @@ void EnemyShrimp::think(real32 time_delta)
 	}
 }
 
+FrameVector<Actor*> Solid::getAllRidingActors(const FrameVector<uint32>& nearby)
+{
+	FrameVector<Actor*> riders(FrameAllocator<Actor*>("riding actors"));
+	const Rect2f rect = getRect();
+	for (const uint32 index : nearby) {
+		Actor* actor = state->AllActors[index];
+		if (!actor->carriedBySolids || actor->noClip || actor->isDead) {
+			continue;
+		}
+		// Resting on the top edge: not overlapping now, but one pixel lower would be
+		if (actor->getHitbox(actor->position + Vector2f(0, 1)).collides(rect) && !actor->getHitbox().collides(rect)) {
+			riders.push_back(actor);
+		}
+	}
+	return riders;
+}
+
+bool Solid::overlapCheck(Actor* actor)
+{
+	return actor->getHitbox().collides(getRect());
+}
+
+/// Moves in whole pixels like actors do. Overlapped actors are pushed out and squished if there is no room,
+/// actors riding on top are carried along. The solid is not collidable while it moves actors, so they
+/// only collide with everything else.
+void Solid::move(real32 x, real32 y)
+{
+	xRemainder += x;
+	yRemainder += y;
+	const int32 moveX = (int32)roundf(xRemainder);
+	const int32 moveY = (int32)roundf(yRemainder);
+	if (moveX == 0 && moveY == 0) {
+		return;
+	}
+
+	Level* level = state->currentLevel;
+	const Rect2f oldRect = getRect();
+	// Everything the move sweeps over, riders one pixel above included
+	const Rect2f reach = {MIN(oldRect.x, oldRect.x + moveX) - actor_grid_slack, MIN(oldRect.y, oldRect.y + moveY) - actor_grid_slack,
+	                      oldRect.w + fabsf((real32)moveX) + 2 * actor_grid_slack, oldRect.h + fabsf((real32)moveY) + 2 * actor_grid_slack};
+	FrameVector<uint32> nearby(FrameAllocator<uint32>("solid nearby actors"));
+	state->solidActors.query(reach, nearby);
+	const FrameVector<Actor*> riders = getAllRidingActors(nearby);
+	collidable = false;
+
+	if (moveX != 0) {
+		xRemainder -= moveX;
+		position.x += moveX;
+		for (const uint32 index : nearby) {
+			Actor* actor = state->AllActors[index];
+			if (!actor->carriedBySolids || actor->noClip || actor->isDead) {
+				continue;
+			}
+			if (overlapCheck(actor)) {
+				const Rect2f hitbox = actor->getHitbox();
+				const real32 push = moveX > 0 ? ceilf(getRight() - hitbox.x) : floorf(getLeft() - (hitbox.x + hitbox.w));
+				actor->moveX(push, [actor]() { actor->die(); });
+			}
+			else if (std::find(riders.begin(), riders.end(), actor) != riders.end()) {
+				actor->moveX((real32)moveX);
+			}
+		}
+	}
+
+	if (moveY != 0) {
+		yRemainder -= moveY;
+		position.y += moveY;
+		for (const uint32 index : nearby) {
+			Actor* actor = state->AllActors[index];
+			if (!actor->carriedBySolids || actor->noClip || actor->isDead) {
+				continue;
+			}
+			if (overlapCheck(actor)) {
+				const Rect2f hitbox = actor->getHitbox();
+				const real32 push = moveY > 0 ? ceilf(getBottom() - hitbox.y) : floorf(getTop() - (hitbox.y + hitbox.h));
+				actor->moveY(push, [actor]() { actor->die(); });
+			}
+			else if (std::find(riders.begin(), riders.end(), actor) != riders.end()) {
+				actor->moveY((real32)moveY);
+			}
+		}
+	}
+
+	collidable = true;
+	dest_rect.x = position.x;
+	dest_rect.y = position.y;
+	level->updateMovingSolidCells((uint32)(this - level->solids.data()), oldRect, getRect());
+}
+
 void Solid::prepare(Level* level) {
 	if (texture == tile1_texture_top) {
 		// Basic ground tile
@@ -2624,10 +4666,10 @@ void EnemyBoss::shootBubbles(real32 time_delta) {
 			targets[1].x = - targets[1].x;
 			targets[2].x = - targets[2].x;
 		}
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, (targets[0]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, (targets[1]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, (targets[0]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, (targets[1]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
 		if (targets[2]){
-			state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, (targets[2]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
+			state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, (targets[2]).getNormalized(), this, bubbleSpeed, false, bubbleLife));
 		}
 		shootCooldown = shootPeriod * (1 - 0.1*bubbleShootCount);
 	}
@@ -2639,9 +4681,9 @@ void EnemyBoss::shootBubbles(real32 time_delta) {
 		if (playerIsBehind) {
 			angle1 = -45;
 		}
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + step), this, bubbleSpeed, false, bubbleLife));
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + 45 + step), this, bubbleSpeed, false, bubbleLife));
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + 90 + step), this, bubbleSpeed, false, bubbleLife));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + step), this, bubbleSpeed, false, bubbleLife));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + 45 + step), this, bubbleSpeed, false, bubbleLife));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(mouthVector, getUnitVectorFromDegrees(angle1 + 90 + step), this, bubbleSpeed, false, bubbleLife));
 		shootCooldown = 0.1f;
 	}
 	else {
@@ -2675,8 +4717,8 @@ void EnemyBoss::sweepAttack(real32 time_delta) {
 		if (timePassed > 0.3f) {
 			sweepState = SweepState::Slash;
 			lastSweepStateTime = state->play_time_passed;
-		} else if (timePassed < 0.15f) {
-			clawFrame = int(timePassed/0.03f) % 5;
+		} else if (timePassed < clawClip->getDuration()) {
+			clawFrame = clawClip->getFrameAt(timePassed);
 		}
 		break;
 	case SweepState::Slash:
@@ -2726,7 +4768,7 @@ void EnemyBoss::bigBubbleAttack(real32 time_delta) {
 		break;
 	case BigBubbleState::Shoot:
 		targetVector = state->player.getCenter() - getCenter();
-		state->newEnemiesQueue.push_back(std::make_unique<EnemyBubble>(position + mouthOffset, targetVector.getNormalized(), this, bubbleSpeed, true));
+		state->newEnemiesQueue.push_back(state->levelArena.make<EnemyBubble>(position + mouthOffset, targetVector.getNormalized(), this, bubbleSpeed, true));
 		shootCooldown = shootPeriod;
 		playSound(shoot);
 		changeState(BossState::Idle);
@@ -2740,12 +4782,27 @@ void EnemyBoss::die() {
 	changeCurrentState(Ending);
 }
 
+// Places the claw hitboxes the same way render() places the claw sprite
+void EnemyBoss::updateClawHitboxes()
+{
+	const Vector2f clawOrigin = {position.x + claw_normal_offset.x, position.y + claw_normal_offset.y + clawPosYWave};
+	const Vector2f pivot = clawOrigin + Vector2f(claw_joint_offset.x, claw_joint_offset.y);
+	const Rotation2f rotation = Rotation2f::fromDegrees(clawAngle + clawAngleWave);
+	for (size_t i = 0; i < clawHitRects.size(); ++i) {
+		Rect2f rect = clawHitRects[i];
+		rect.x += clawOrigin.x;
+		rect.y += clawOrigin.y;
+		clawHitboxes[i] = OrientedRect2f::fromRotatedRect(rect, pivot, rotation);
+	}
+}
+
 void EnemyBoss::update(real32 time_delta, const ControllerInput* input)
 {
 	Actor::update(time_delta, input);
 	real32 bobTimer;
 	clawAngleWave = 3.f * sinf(2 * Pi32 * fmod(state->play_time_passed, 4.f)/4.f);
 	// clawPosYWave = 30.f * sinf(2 * Pi32 * fmod(state->play_time_passed, 6.f)/6.f);
+	updateClawHitboxes();
 
 	if (!state->player.isDying() && !state->player.invulTime && bossState != BossState::Stunned && bossState != BossState::Hurt) {
 		Rect2f playerHitbox = state->player.getHitbox();
@@ -2753,14 +4810,10 @@ void EnemyBoss::update(real32 time_delta, const ControllerInput* input)
 			state->player.hurt(this);
 		}
 		else {
-			for (Rect2f rect : clawHitRects) {
-				Vector2f center = rect.getCenter();
-				Vector2f rotated = rotatePoint({center.x+ claw_normal_offset.x + position.x, center.y + claw_normal_offset.y + position.y}, {claw_joint_offset.x + position.x, claw_joint_offset.y + position.y}, (clawAngle + clawAngleWave)*0.75);
-				rect.x = rotated.x - rect.w/2;
-				rect.y = rotated.y - rect.h/2;
-
-				if (rect.collides(playerHitbox)) {
+			for (const OrientedRect2f& hitbox : clawHitboxes) {
+				if (hitbox.collides(playerHitbox)) {
 					state->player.hurt(this);
+					break;
 				}
 			}
 		}
@@ -2840,7 +4893,7 @@ void EnemyBoss::update(real32 time_delta, const ControllerInput* input)
 						playSound(enter_butt);
 					}
 				}
-				stun_frame = int(fmod((state->play_time_passed - lastStateTime) * 10, 5.f));
+				stunFrame = stunClip->getFrameAt(state->play_time_passed - lastStateTime);
 			}
 			break;
 		case BossState::Hurt:
@@ -2858,17 +4911,12 @@ void EnemyBoss::update(real32 time_delta, const ControllerInput* input)
 
 inline void EnemyBoss::render(SDL_Renderer* renderer)
 {
-	SDL_Rect stun_sprite_rect;
 	SDL_FRect stun_dest_rect;
-	int32 stun_width = 687;
 	if (visible)
 	{
-		SDL_Rect main_sprite_rect;
-		SDL_FRect main_dest_rect;
-		SDL_Rect claw_sprite_rect;
+		const SDL_Rect* main_sprite_rect = animation.getRect();
+		const SDL_FRect main_dest_rect = {position.x, position.y, width, height};
 		SDL_FRect claw_dest_rect;
-		SDL_Rect smallclaw_sprite_rect;
-		SDL_FRect smallclaw_dest_rect;
 		switch (bossState)
 		{
 		case BossState::Waiting:
@@ -2876,14 +4924,10 @@ inline void EnemyBoss::render(SDL_Renderer* renderer)
 		case BossState::Bubbles:
 		case BossState::BigBubble:
 		case BossState::Sweep:
-			main_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			main_dest_rect = {position.x, position.y, width, height};
-			claw_sprite_rect = {static_cast<int>(clawFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
 			claw_dest_rect = {position.x + claw_normal_offset.x, position.y + claw_normal_offset.y + clawPosYWave, width, height};
-			smallclaw_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			renderTextureEx(renderer, textureClaw, &claw_sprite_rect, &claw_dest_rect, clawAngle + clawAngleWave, &claw_joint_offset, SDL_FLIP_NONE);
-			renderTextureEx(renderer, bossState == BossState::Bubbles ? enemy_boss_texture_spit : currentTexture->texture, &main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
-			renderTextureEx(renderer, textureSmallclaw, &main_sprite_rect, &main_dest_rect, smallclawAngle, &smallclaw_joint_offset, SDL_FLIP_NONE);
+			renderTextureEx(renderer, clawClip->texture, &clawClip->frames[clawFrame], &claw_dest_rect, clawAngle + clawAngleWave, &claw_joint_offset, SDL_FLIP_NONE);
+			renderTextureEx(renderer, bossState == BossState::Bubbles ? enemy_boss_texture_spit : animation.getTexture(), main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
+			renderTextureEx(renderer, textureSmallclaw, main_sprite_rect, &main_dest_rect, smallclawAngle, &smallclaw_joint_offset, SDL_FLIP_NONE);
 			break;
 		case BossState::Hurt:
 			if (fmod(state->play_time_passed - lastStateTime, 1.f) < 0.5f) {
@@ -2892,22 +4936,13 @@ inline void EnemyBoss::render(SDL_Renderer* renderer)
 			else {
 				SDL_SetTextureColorMod(textureMainStunned, 255, 255, 255);
 			}
-			main_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			main_dest_rect = {position.x, position.y, width, height};
-			claw_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			claw_dest_rect = {position.x, position.y, width, height};
-			renderTextureEx(renderer, textureMainStunned, &main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
+			renderTextureEx(renderer, textureMainStunned, main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
 			break;
 		case BossState::Stunned:
-			main_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			main_dest_rect = {position.x, position.y, width, height};
-			claw_sprite_rect = {static_cast<int>(currentFrame * width), 0, static_cast<int>(width), static_cast<int>(height)};
-			claw_dest_rect = {position.x, position.y, width, height};
-			renderTextureEx(renderer, textureMainStunned, &main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
+			renderTextureEx(renderer, textureMainStunned, main_sprite_rect, &main_dest_rect, 0, NULL, SDL_FLIP_NONE);
 			
-			stun_sprite_rect = {stun_frame*stun_width, 0, stun_width, 348};
-			stun_dest_rect = {position.x + 884.f, position.y + 303.f, (real32)stun_width, 348.f};
-			renderTextureEx(renderer, stun_texture, &stun_sprite_rect, &stun_dest_rect, 0, NULL, SDL_FLIP_NONE);
+			stun_dest_rect = {position.x + 884.f, position.y + 303.f, (real32)stunClip->frames[stunFrame].w, (real32)stunClip->frames[stunFrame].h};
+			renderTextureEx(renderer, stunClip->texture, &stunClip->frames[stunFrame], &stun_dest_rect, 0, NULL, SDL_FLIP_NONE);
 			break;
 		default:
 			break;
@@ -2915,56 +4950,20 @@ inline void EnemyBoss::render(SDL_Renderer* renderer)
 	}
 }
 
-void Decor::update(real32 time_delta, const ControllerInput* input) 
+// Decor has no per-instance state, every decor playing the same clip follows the shared play clock
+void Decor::render(SDL_Renderer* renderer)
 {
-	// currentTexture = textureIdle;todo delete
-	uint32 totalFrames = currentTexture->size.x / width;
-	if (totalFrames > 1) {
-		real32 animationDelay = idleAnimationDelay;
-		
-		// Animation
-		currentFrame = (currentFrame) % totalFrames;
-		if (state->play_time_passed - lastAnimationTime > animationDelay)
-		{
-			lastAnimationTime = state->play_time_passed;
-			uint32 totalFrames = currentTexture->size.x / width;
-			currentFrame = (currentFrame + 1) % totalFrames;
-		}
+	if (visible)
+	{
+		const AnimationClip* clip = animation.clip;
+		const SDL_FRect rect = {position.x, position.y, width, height};
+		renderTexture(renderer, clip->texture, &clip->frames[clip->getFrameAt(state->play_time_passed)], &rect);
 	}
 }
 
 
-void Diagonal::update(real32 time_delta, const ControllerInput* input) {
-	Vector2f deltaPos = {0, 0};
-	if (checkAABBLineCollision(p1, p2, state->player.getHitbox(), &deltaPos, &normal)) {
-		state->player.position += deltaPos;
-		Vector2f& vel = state->player.velocity;
-		if (!state->player.isPuffed && state->player.puffingFrames == 0) {
-			Vector2f perpendicular = normal * dot(vel, normal);
-			vel -= perpendicular;
-		}
-		else {
-			real32 absX = abs(vel.x);
-			real32 absY = abs(vel.y);
-			if (absY != 0 && absX / absY > 4) {
-				vel.y = 0;
-			}
-			else if (absX != 0 && absY / absX > 4) {
-				vel.x = 0;
-			}
-
-			const real32 temp = vel.y;
-			vel.y = vel.x;
-			vel.x = temp;
-			if (direction == DiagDir::BotRight || direction == DiagDir::TopLeft) {
-				vel = - vel;
-			}
-		}
-	}
-}
-
 void Diagonal::render(SDL_Renderer* renderer) {
-	renderTextureEx(renderer, currentTexture->texture, &sprite_rect, &dest_rect, 0, NULL, flip);
+	renderTextureEx(renderer, animation.getTexture(), &sprite_rect, &dest_rect, 0, NULL, flip);
 }
 
 void Key::update(real32 time_delta, const ControllerInput* _input) {
@@ -3115,31 +5114,26 @@ void Grampa::update(real32 time_delta, const ControllerInput* input) {
 
 inline void Grampa::render(SDL_Renderer* renderer)
 {
-	if (!speech_font) {
-		// c++ broke and now I have to do it this way
-		speech_font = FC_CreateFont();
-		FC_LoadFont(speech_font, renderer, "assets/Action_Man.ttf", 20*6, FC_MakeColor(255, 255, 255, 255), TTF_STYLE_NORMAL);
-	}
 	int32 currentLevelId = state->currentLevel - state->levels;
 	Actor::render(renderer);
 	if (grampaState == 1 && currentLine < messages[currentLevelId].size()) {
-		int32 width = FC_GetWidth(speech_font, messages[currentLevelId][currentLine].c_str());
-		int32 height = FC_GetHeight(speech_font, messages[currentLevelId][currentLine].c_str());
+		const char* line = messages[currentLevelId][currentLine].c_str();
+		const SDL_Point textSize = text_cache.measure(speech_font, line);
 		Vector2f textPos = position;
-		textPos.y -= height + 20;
-		textPos.x -= width/2;
-		textPos.x -= state->camera.x;
-		textPos.y -= state->camera.y;
-		renderOutlinedText(speech_font, renderer, textPos.x, textPos.y, messages[currentLevelId][currentLine].c_str());
+		textPos.y -= textSize.y + 20;
+		textPos.x -= textSize.x/2;
+		textPos.x += state->screenShake.x - state->camera.x;
+		textPos.y += state->screenShake.y - state->camera.y;
+		text_cache.draw(speech_font, renderer, textPos.x, textPos.y, line, 3, {255, 255, 255, 255});
 	}
 }
 
 
 void renderTexture(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_FRect* destRect) {
-    SDL_FRect renderDestRect = { destRect->x - state->camera.x, destRect->y - state->camera.y, destRect->w, destRect->h };
+    SDL_FRect renderDestRect = { destRect->x - state->camera.x + state->screenShake.x, destRect->y - state->camera.y + state->screenShake.y, destRect->w, destRect->h };
     SDL_RenderCopyF(renderer, texture, sourceRect, &renderDestRect);
 }
 void renderTextureEx(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_FRect* destRect, const double angle, const SDL_FPoint* center, SDL_RendererFlip flip) {
-    SDL_FRect renderDestRect = { destRect->x - state->camera.x, destRect->y - state->camera.y, destRect->w, destRect->h };
+    SDL_FRect renderDestRect = { destRect->x - state->camera.x + state->screenShake.x, destRect->y - state->camera.y + state->screenShake.y, destRect->w, destRect->h };
     SDL_RenderCopyExF(renderer, texture, sourceRect, &renderDestRect, angle, center, flip);
 }
\ No newline at end of file
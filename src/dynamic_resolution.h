@@ -0,0 +1,155 @@
+#pragma once
+
+#include <SDL.h>
+#include "definitions.h"
+
+// Scene resolution as a fraction of the output resolution
+constexpr real32 render_scale_min = 0.5f;
+constexpr real32 render_scale_max = 1.0f;
+constexpr real32 render_scale_step = 0.125f;
+// Frames averaged before each decision
+constexpr uint32 render_scale_window = 30;
+// Frames to wait after a change before the next one, so the scale does not oscillate
+constexpr uint32 render_scale_cooldown = 120;
+// Over budget by this much lowers the scale, under budget by this much raises it
+constexpr real32 render_scale_over_budget = 1.1f;
+constexpr real32 render_scale_under_budget = 0.6f;
+
+/// Draws the scene into an offscreen target at a fraction of the output resolution and upscales it,
+/// so weak machines do not pay for a full 4K-equivalent canvas. The fraction follows a rolling
+/// average of the measured frame time. Anything drawn outside beginScene/endScene, like the HUD,
+/// stays at native resolution.
+class DynamicResolution
+{
+public:
+	void init(real32 targetFrameSeconds)
+	{
+		budget = targetFrameSeconds;
+	}
+
+	/// Drops the target texture, it is recreated on the next scene. Call on renderer resets.
+	void reset()
+	{
+		if (target)
+		{
+			SDL_DestroyTexture(target);
+			target = nullptr;
+		}
+	}
+
+	void beginScene(SDL_Renderer* renderer)
+	{
+		if (scale >= render_scale_max || !SDL_RenderTargetSupported(renderer))
+		{
+			return;
+		}
+
+		int32 outputWidth, outputHeight;
+		SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+		if (!target || outputWidth != targetWidth || outputHeight != targetHeight)
+		{
+			reset();
+			target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, outputWidth, outputHeight);
+			if (!target)
+			{
+				LogWarn("Could not create the scene target, drawing at full resolution: %s", SDL_GetError());
+				scale = render_scale_max;
+				return;
+			}
+			SDL_SetTextureScaleMode(target, SDL_ScaleModeLinear);
+			targetWidth = outputWidth;
+			targetHeight = outputHeight;
+		}
+
+		// Only the top left part of the target is used, so changing the scale never reallocates
+		previousTarget = SDL_GetRenderTarget(renderer);
+		SDL_RenderGetScale(renderer, &previousScale.x, &previousScale.y);
+		SDL_SetRenderTarget(renderer, target);
+		SDL_RenderSetScale(renderer, scale * targetWidth / SCREEN_WIDTH, scale * targetHeight / SCREEN_HEIGHT);
+		SDL_RenderClear(renderer);
+		inScene = true;
+	}
+
+	void endScene(SDL_Renderer* renderer)
+	{
+		if (!inScene)
+		{
+			return;
+		}
+		inScene = false;
+
+		SDL_SetRenderTarget(renderer, previousTarget);
+		if (previousTarget)
+		{
+			// Switching to a texture target resets the scale
+			SDL_RenderSetScale(renderer, previousScale.x, previousScale.y);
+		}
+		const SDL_Rect sourceRect = {0, 0, (int32)(scale * targetWidth), (int32)(scale * targetHeight)};
+		const SDL_Rect destRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+		SDL_RenderCopy(renderer, target, &sourceRect, &destRect);
+	}
+
+	/// frameSeconds is the time between presents, workSeconds the part of it spent before presenting.
+	/// With vsync, missing the budget shows up in frameSeconds and the headroom in workSeconds.
+	void recordFrame(real32 frameSeconds, real32 workSeconds)
+	{
+		frameSum += frameSeconds;
+		workSum += workSeconds;
+		sampleCount++;
+		if (cooldown > 0)
+		{
+			cooldown--;
+		}
+		if (sampleCount < render_scale_window)
+		{
+			return;
+		}
+
+		const real32 averageFrame = frameSum / sampleCount;
+		const real32 averageWork = workSum / sampleCount;
+		frameSum = workSum = 0;
+		sampleCount = 0;
+		if (cooldown > 0)
+		{
+			return;
+		}
+
+		real32 newScale = scale;
+		if (averageFrame > budget * render_scale_over_budget)
+		{
+			newScale = MAX(scale - render_scale_step, render_scale_min);
+		}
+		else if (averageWork < budget * render_scale_under_budget && averageFrame < budget * render_scale_over_budget)
+		{
+			newScale = MIN(scale + render_scale_step, render_scale_max);
+		}
+
+		if (newScale != scale)
+		{
+			LogInfo("Render scale %.3f -> %.3f (frame %.2f ms, work %.2f ms)", scale, newScale, averageFrame * 1000, averageWork * 1000);
+			scale = newScale;
+			cooldown = render_scale_cooldown;
+		}
+	}
+
+	inline real32 getScale() const
+	{
+		return scale;
+	}
+
+private:
+	SDL_Texture* target = nullptr;
+	SDL_Texture* previousTarget = nullptr;
+	SDL_FPoint previousScale = {1, 1};
+	int32 targetWidth = 0;
+	int32 targetHeight = 0;
+	bool inScene = false;
+	real32 scale = render_scale_max;
+	real32 budget = 1.0f / 60;
+	real32 frameSum = 0;
+	real32 workSum = 0;
+	uint32 sampleCount = 0;
+	uint32 cooldown = 0;
+};
+
+DynamicResolution dynamic_resolution;
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+#include "definitions.h"
+#include "SDL_FontCache.h"
+
+// Written by tools/font_baker.cpp
+#define BAKED_FONT_DIR "assets/fonts/"
+constexpr int32 max_baked_font_levels = 10;
+
+/// Path prefix of the baked files for a font, e.g. "assets/fonts/Action_Man_144"
+inline std::string getBakedFontPrefix(const char* ttfFilename, uint32 pointSize)
+{
+	std::string name = ttfFilename;
+	const size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+	{
+		name = name.substr(slash + 1);
+	}
+	const size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos)
+	{
+		name = name.substr(0, dot);
+	}
+	return BAKED_FONT_DIR + name + "_" + std::to_string(pointSize);
+}
+
+/// Uploads the prebaked glyph atlases of the font, so no TrueType work is done at load time.
+/// Glyphs that were not baked are rasterized from the TTF on first use.
+/// Falls back to loading the TTF directly if the font has not been baked.
+bool loadFont(FC_Font* font, SDL_Renderer* renderer, const char* ttfFilename, uint32 pointSize, SDL_Color color, int style = TTF_STYLE_NORMAL)
+{
+	[[maybe_unused]] const uint64 start = SDL_GetPerformanceCounter();
+	const std::string prefix = getBakedFontPrefix(ttfFilename, pointSize);
+	bool loaded = false;
+
+	std::string metrics;
+	SDL_RWops* file = SDL_RWFromFile((prefix + ".fnt").c_str(), "rb");
+	if (file)
+	{
+		const Sint64 size = SDL_RWsize(file);
+		if (size > 0)
+		{
+			metrics.resize(size);
+			SDL_RWread(file, metrics.data(), 1, size);
+		}
+		SDL_RWclose(file);
+	}
+
+	if (!metrics.empty())
+	{
+		SDL_Surface* levels[max_baked_font_levels];
+		int32 levelCount = 0;
+		for (; levelCount < max_baked_font_levels; levelCount++)
+		{
+			levels[levelCount] = IMG_Load((prefix + "_" + std::to_string(levelCount) + ".png").c_str());
+			if (!levels[levelCount])
+			{
+				break;
+			}
+		}
+
+		loaded = levelCount > 0 && FC_LoadFontFromBaked(font, renderer, levels, levelCount, metrics.c_str(), color);
+		if (loaded)
+		{
+			FC_SetFallbackFont(font, ttfFilename, pointSize, style);
+		}
+		for (int32 i = 0; i < levelCount; i++)
+		{
+			SDL_FreeSurface(levels[i]);
+		}
+	}
+
+	if (!loaded)
+	{
+		LogWarn("Font %s has no usable baked atlas, rasterizing %s at %u", prefix.c_str(), ttfFilename, pointSize);
+		loaded = FC_LoadFont(font, renderer, ttfFilename, pointSize, color, style);
+	}
+
+	LogInfo("Font %s loaded in %.2f ms", prefix.c_str(), 1000.0 * (real64)(SDL_GetPerformanceCounter() - start) / (real64)SDL_GetPerformanceFrequency());
+	return loaded;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// Bytes in one block of the frame arena. A frame that needs more gets more blocks, they are kept for the next frames.
+constexpr size_t frame_arena_block_size = 256 * 1024;
+// Allocation sites tracked by the debug statistics
+constexpr size_t frame_arena_max_sites = 32;
+
+/// Bump allocator for data that only lives during one tick: reset() at the start of the tick drops everything
+/// allocated since the last one. Nothing is freed on its own, so only short lived scratch belongs here.
+class FrameArena
+{
+public:
+	/// site names the caller in the debug statistics, it must be a string literal.
+	/// alignment is at most alignof(max_align_t), which every block starts at.
+	void* allocate(size_t bytes, size_t alignment, [[maybe_unused]] const char* site)
+	{
+		if (blocks.empty())
+		{
+			blocks.push_back(makeBlock(frame_arena_block_size));
+		}
+		size_t offset = (blockOffset + alignment - 1) & ~(alignment - 1);
+		if (offset + bytes > blocks[currentBlock].size)
+		{
+			// The rest of this block stays unused until the next reset
+			currentBlock++;
+			if (currentBlock == blocks.size() || blocks[currentBlock].size < bytes)
+			{
+				blocks.insert(blocks.begin() + currentBlock, makeBlock(bytes > frame_arena_block_size ? bytes : frame_arena_block_size));
+			}
+			offset = 0;
+		}
+		blockOffset = offset + bytes;
+		frameBytes += bytes;
+#if DEBUG
+		noteAllocation(site, bytes);
+#endif
+		return blocks[currentBlock].data.get() + offset;
+	}
+
+	/// Frees everything allocated since the last reset
+	void reset()
+	{
+		peakFrameBytes = frameBytes > peakFrameBytes ? frameBytes : peakFrameBytes;
+		totalFrameBytes += frameBytes;
+		frames++;
+		frameBytes = 0;
+		currentBlock = 0;
+		blockOffset = 0;
+	}
+
+	inline size_t getFrameBytes() const
+	{
+		return frameBytes;
+	}
+
+	inline size_t getCapacity() const
+	{
+		size_t capacity = 0;
+		for (const Block& block : blocks)
+		{
+			capacity += block.size;
+		}
+		return capacity;
+	}
+
+	/// Bytes per frame since the last call and which sites they came from, for debug builds
+	void logStats()
+	{
+#if DEBUG
+		if (frames == 0)
+		{
+			return;
+		}
+		LogInfo("Frame arena (%u frames): mean %zu bytes, peak %zu, %zu in %zu blocks", frames, totalFrameBytes / frames,
+		        peakFrameBytes, getCapacity(), blocks.size());
+		for (size_t i = 0; i < siteCount; ++i)
+		{
+			LogInfo("  %-24s %10zu bytes, %u allocations per frame", sites[i].name, sites[i].bytes / frames, sites[i].allocations / frames);
+			sites[i].bytes = 0;
+			sites[i].allocations = 0;
+		}
+#endif
+		peakFrameBytes = 0;
+		totalFrameBytes = 0;
+		frames = 0;
+	}
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0;
+	};
+
+	struct Site
+	{
+		const char* name = nullptr;
+		size_t bytes = 0;
+		uint32_t allocations = 0;
+	};
+
+	static Block makeBlock(size_t size)
+	{
+		return {std::make_unique<uint8_t[]>(size), size};
+	}
+
+	void noteAllocation(const char* site, size_t bytes)
+	{
+		// Sites are literals, comparing the pointers is enough
+		for (size_t i = 0; i < siteCount; ++i)
+		{
+			if (sites[i].name == site)
+			{
+				sites[i].bytes += bytes;
+				sites[i].allocations++;
+				return;
+			}
+		}
+		if (siteCount < frame_arena_max_sites)
+		{
+			sites[siteCount++] = {site, bytes, 1};
+		}
+	}
+
+	std::vector<Block> blocks;
+	size_t currentBlock = 0;
+	size_t blockOffset = 0;
+	size_t frameBytes = 0;
+	size_t peakFrameBytes = 0;
+	size_t totalFrameBytes = 0;
+	uint32_t frames = 0;
+	Site sites[frame_arena_max_sites];
+	size_t siteCount = 0;
+};
+
+FrameArena frame_arena;
+
+/// STL allocator on the frame arena, deallocate does nothing
+template <typename T>
+struct FrameAllocator
+{
+	using value_type = T;
+
+	explicit FrameAllocator(const char* site, FrameArena* arena = &frame_arena) : arena(arena), site(site)
+	{
+	}
+
+	template <typename U>
+	FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena), site(other.site)
+	{
+	}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T), site));
+	}
+
+	void deallocate(T*, size_t)
+	{
+	}
+
+	template <typename U>
+	bool operator==(const FrameAllocator<U>& other) const
+	{
+		return arena == other.arena;
+	}
+
+	FrameArena* arena;
+	const char* site;
+};
+
+/// A vector that must not outlive the tick it was made in
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
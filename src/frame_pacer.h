@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <string.h>
+#include <SDL.h>
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <errno.h>
+#include <time.h>
+#endif
+#include "definitions.h"
+#include "timing_history.h"
+
+enum class FramePacing
+{
+	// Let SDL_RenderPresent block on the display, used when the display runs at the game rate
+	Vsync,
+	// Sleep until shortly before the deadline, then spin the rest of the way
+	HybridSleep,
+	// No waiting at all, for profiling
+	Uncapped,
+	Auto
+};
+
+// Bounds of the spin that follows the sleep, it adapts to how late the sleeps wake up
+constexpr real64 frame_pacer_min_spin_seconds = 0.0002;
+constexpr real64 frame_pacer_max_spin_seconds = 0.002;
+
+struct FramePacerStats
+{
+	TimingSummary frames;
+	// Mean difference between consecutive present intervals
+	real32 jitterMs = 0;
+	// Intervals longer than one and a half frames
+	uint32 missedFrames = 0;
+	// Part of the waiting that was spent spinning instead of sleeping
+	real32 spinFraction = 0;
+};
+
+inline const char* getFramePacingName(FramePacing mode)
+{
+	switch (mode)
+	{
+	case FramePacing::Vsync: return "vsync";
+	case FramePacing::HybridSleep: return "hybrid";
+	case FramePacing::Uncapped: return "uncapped";
+	default: return "auto";
+	}
+}
+
+inline FramePacing parseFramePacing(const char* name)
+{
+	if (strcmp(name, "vsync") == 0) return FramePacing::Vsync;
+	if (strcmp(name, "hybrid") == 0) return FramePacing::HybridSleep;
+	if (strcmp(name, "uncapped") == 0) return FramePacing::Uncapped;
+	return FramePacing::Auto;
+}
+
+/// Holds frames to the target rate and records when each one was presented.
+/// Call waitForDeadline right before SDL_RenderPresent and onPresent right after it.
+class FramePacer
+{
+public:
+	void init(SDL_Window* window, SDL_Renderer* renderer, FramePacing requested, real64 targetSeconds)
+	{
+		frequency = SDL_GetPerformanceFrequency();
+		targetCounts = (uint64)(targetSeconds * frequency);
+		spinSeconds = frame_pacer_max_spin_seconds;
+
+		mode = requested;
+		if (mode == FramePacing::Auto)
+		{
+			// Vsync only paces correctly when the display refreshes at the game rate
+			SDL_DisplayMode displayMode;
+			const bool matchingDisplay = SDL_GetWindowDisplayMode(window, &displayMode) == 0 &&
+			                             std::abs(displayMode.refresh_rate - (int32)(1.0 / targetSeconds + 0.5)) <= 1;
+			mode = matchingDisplay ? FramePacing::Vsync : FramePacing::HybridSleep;
+		}
+		setMode(renderer, mode);
+	}
+
+	void setMode(SDL_Renderer* renderer, FramePacing newMode)
+	{
+		mode = newMode;
+#ifndef __EMSCRIPTEN__
+		if (SDL_RenderSetVSync(renderer, mode == FramePacing::Vsync ? 1 : 0) != 0 && mode == FramePacing::Vsync)
+		{
+			LogWarn("Could not enable vsync, sleeping instead: %s", SDL_GetError());
+			mode = FramePacing::HybridSleep;
+		}
+#endif
+		deadline = 0;
+		resetStats();
+		LogInfo("Frame pacing: %s", getFramePacingName(mode));
+	}
+
+	inline FramePacing getMode() const
+	{
+		return mode;
+	}
+
+	void waitForDeadline()
+	{
+#ifndef __EMSCRIPTEN__
+		if (mode != FramePacing::HybridSleep)
+		{
+			return;
+		}
+
+		const uint64 now = SDL_GetPerformanceCounter();
+		if (deadline == 0 || now > deadline + targetCounts)
+		{
+			// First frame or more than a frame late, start counting from here instead of trying to catch up
+			deadline = now;
+			return;
+		}
+
+		const uint64 spinCounts = (uint64)(spinSeconds * frequency);
+		if (deadline > now + spinCounts)
+		{
+			const uint64 wakeTarget = deadline - spinCounts;
+			sleepSeconds((real64)(wakeTarget - now) / frequency);
+			const uint64 woke = SDL_GetPerformanceCounter();
+			sleptCounts += woke - now;
+			adaptSpin(woke > wakeTarget ? (real64)(woke - wakeTarget) / frequency : 0);
+		}
+
+		const uint64 spinStart = SDL_GetPerformanceCounter();
+		while (SDL_GetPerformanceCounter() < deadline)
+		{
+			// Waiting...
+		}
+		spunCounts += SDL_GetPerformanceCounter() - spinStart;
+#endif
+	}
+
+	void onPresent()
+	{
+		const uint64 now = SDL_GetPerformanceCounter();
+		if (lastPresent != 0)
+		{
+			intervals.add((real32)(1000.0 * (real64)(now - lastPresent) / frequency));
+		}
+		lastPresent = now;
+
+		if (mode == FramePacing::HybridSleep)
+		{
+			deadline = (deadline == 0 ? now : deadline) + targetCounts;
+		}
+	}
+
+	FramePacerStats getStats() const
+	{
+		FramePacerStats stats;
+		stats.frames = intervals.summarize();
+
+		const uint32 count = intervals.getCount();
+		const real32 targetMs = (real32)(1000.0 * (real64)targetCounts / frequency);
+		real32 jitterSum = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			const real32 interval = intervals.get(i);
+			if (i > 0)
+			{
+				jitterSum += std::abs(interval - intervals.get(i - 1));
+			}
+			if (interval > targetMs * 1.5f)
+			{
+				stats.missedFrames++;
+			}
+		}
+		stats.jitterMs = count > 1 ? jitterSum / (count - 1) : 0;
+		const uint64 waited = sleptCounts + spunCounts;
+		stats.spinFraction = waited > 0 ? (real32)((real64)spunCounts / waited) : 0;
+		return stats;
+	}
+
+	void logStats() const
+	{
+#if DEBUG
+		const FramePacerStats stats = getStats();
+		LogInfo("Frames (%s, %u): mean %.2f ms, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f, jitter %.3f ms, missed %u, spin %.1f%% of wait",
+		        getFramePacingName(mode), stats.frames.sampleCount, stats.frames.meanMs, stats.frames.p50Ms, stats.frames.p95Ms,
+		        stats.frames.p99Ms, stats.frames.maxMs,
+		        stats.jitterMs, stats.missedFrames, stats.spinFraction * 100);
+#endif
+	}
+
+	/// The loop blocked on input, so the next present interval says nothing about pacing
+	inline void markIdle()
+	{
+		lastPresent = 0;
+		deadline = 0;
+	}
+
+	void resetStats()
+	{
+		intervals.clear();
+		lastPresent = 0;
+		sleptCounts = spunCounts = 0;
+	}
+
+private:
+	static void sleepSeconds(real64 seconds)
+	{
+#if defined(_WIN32)
+		// SDL raises the system timer resolution to 1 ms, so only whole milliseconds are worth sleeping
+		const uint32 ms = (uint32)(seconds * 1000);
+		if (ms > 0)
+		{
+			SDL_Delay(ms);
+		}
+#elif !defined(__EMSCRIPTEN__)
+		timespec remaining;
+		remaining.tv_sec = (time_t)seconds;
+		remaining.tv_nsec = (long)((seconds - (real64)remaining.tv_sec) * 1e9);
+		while (clock_nanosleep(CLOCK_MONOTONIC, 0, &remaining, &remaining) == EINTR)
+		{
+		}
+#endif
+	}
+
+	/// Keeps the spin just above the recent oversleep, so sleeping late rarely misses the deadline
+	void adaptSpin(real64 overslept)
+	{
+		const real64 wanted = overslept * 1.5;
+		spinSeconds = wanted > spinSeconds ? wanted : spinSeconds * 0.95 + wanted * 0.05;
+		spinSeconds = MAX(frame_pacer_min_spin_seconds, MIN(spinSeconds, frame_pacer_max_spin_seconds));
+	}
+
+	FramePacing mode = FramePacing::Vsync;
+	uint64 frequency = 1;
+	uint64 targetCounts = 0;
+	uint64 deadline = 0;
+	real64 spinSeconds = frame_pacer_max_spin_seconds;
+
+	TimingHistory intervals;
+	uint64 lastPresent = 0;
+	uint64 sleptCounts = 0;
+	uint64 spunCounts = 0;
+};
+
+FramePacer frame_pacer;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class FunctionRef;
+
+/// Non-owning reference to a callable, for callbacks that are only called during the call they are passed to.
+/// Unlike std::function it never copies the callable or allocates, so the callable must outlive it: pass lambdas
+/// straight to the call, do not keep a FunctionRef around.
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)>
+{
+public:
+	FunctionRef() = default;
+
+	FunctionRef(std::nullptr_t)
+	{
+	}
+
+	template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef>>>
+	FunctionRef(F&& function)
+		: object((void*)std::addressof(function)),
+		  call([](void* object, Args... args) -> R { return (*(std::remove_reference_t<F>*)object)(std::forward<Args>(args)...); })
+	{
+	}
+
+	R operator()(Args... args) const
+	{
+		return call(object, std::forward<Args>(args)...);
+	}
+
+	explicit operator bool() const
+	{
+		return call != nullptr;
+	}
+
+private:
+	void* object = nullptr;
+	R (*call)(void*, Args...) = nullptr;
+};
@@ -2,12 +2,19 @@
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <fstream>
 #include <SDL.h>
 #include <SDL_mixer.h>
 #include <SDL_image.h>
 #include <SDL_ttf.h>
 #include "definitions.h"
 #include "SDL_FontCache.h"
+#include "music.h"
+#include "fonts.h"
+#include "dynamic_resolution.h"
+#include "frame_pacer.h"
+#include "input.h"
+#include "particles.h"
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #endif
@@ -28,6 +35,11 @@ uint64 perf_frequency = SDL_GetPerformanceFrequency();
 SDL_Surface* screen_surface = NULL;
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
+// When draw() finished submitting the frame, before presenting it
+static uint64 draw_work_end_counter = 0;
+// Last gameplay frame, redrawn under the overlays of states that do not simulate the world
+SDL_Texture* frame_snapshot_texture = NULL;
+bool frame_snapshot_valid = false;
 
 FC_Font* medium_font;
 FC_Font* large_font;
@@ -37,6 +49,26 @@ static int32 gamepad_index = 0;
 const int8 shake_xs[] = { -6, 3, 5, 2, -3, 2, -2, 0 };
 const int8 shake_ys[] = { 3, -6, 2, 4, -2, 3, 1, -1 };
 
+// How a shaken frame is drawn: every draw call adds GameState::screenShake, or the old way of drawing the frame into a
+// full screen render target and copying it back offset. --shake=target picks the old way, to compare the two.
+enum class ShakeMode
+{
+	Offset, RenderTarget
+};
+static ShakeMode shake_mode = ShakeMode::Offset;
+
+#if DEBUG
+// Average draw() cost of shake frames compared to normal frames, logged after each shake
+struct DrawCostStats
+{
+	real64 shakeMs = 0;
+	uint32 shakeFrames = 0;
+	real64 normalMs = 0;
+	uint32 normalFrames = 0;
+};
+static DrawCostStats draw_cost_stats;
+#endif
+
 static void SDLInitGamepads()
 {
 	const int32 max_joysticks = SDL_NumJoysticks();
@@ -60,190 +92,213 @@ static void SDLInitGamepads()
 }
 
 
-void handleEvents(ControllerInput& controller)
+// Maps one input event onto the controller state
+void applyInputEvent(ControllerInput& controller, const SDL_Event& event)
 {
-	SDL_Event event;
-	while (SDL_PollEvent(&event))
+	if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat)
 	{
-		if (event.type == SDL_QUIT)
+		const bool is_down = event.type == SDL_KEYDOWN;
+
+		switch (event.key.keysym.sym)
 		{
-			closing = true;
+		//case SDLK_w:
+		case SDLK_UP:
+			controller.dir_up = is_down ? 1.0f : 0;
+			break;
+		//case SDLK_s:
+		case SDLK_DOWN:
+			controller.dir_down = is_down ? 1.0f : 0;
+			break;
+		//case SDLK_a:
+		case SDLK_LEFT:
+			controller.dir_left = is_down ? 1.0f : 0;
+			break;
+		//case SDLK_d:
+		case SDLK_RIGHT:
+			controller.dir_right = is_down ? 1.0f : 0;
+			break;
+		case SDLK_SPACE:
+		case SDLK_p:
+			controller.button_start = is_down;
+			break;
+		case SDLK_ESCAPE:
+			controller.button_select = is_down;
+			break;
+		case SDLK_x:
+			controller.button_a = is_down;
+			break;
+		case SDLK_n:
+			controller.button_l = is_down;
+			break;
+		// case SDLK_w://todo remove
+		// 	if (state->currentLevel == state->levels + 3) {
+		// 		changeCurrentState(Ending);
+		// 	}
+		// 	else {
+		// 		changeCurrentState(Victory);
+		// 	}
+		// 	break;
 		}
-		else if (event.type == SDL_CONTROLLERDEVICEADDED)
+	}
+	else if (event.type == SDL_CONTROLLERAXISMOTION)
+	{
+		real32 value;
+		if (event.caxis.value > 0)
 		{
-			LogInfo("Controller added: %d\n", event.cdevice.which);
-			const int32 device_index = event.cdevice.which;
-			if (SDL_IsGameController(device_index))
-			{
-				SDL_GameController* game_controller = SDL_GameControllerOpen(device_index);
-			}
+			value = ((real32)event.caxis.value) / 32767.f;
 		}
-		else if (event.type == SDL_CONTROLLERDEVICEREMOVED)
+		else
 		{
-			LogInfo("Controller removed: %d\n", event.cdevice.which);
-			int32 instance_id = event.cdevice.which;
+			value = ((real32)event.caxis.value) / 32768.f;
 		}
-		else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat)
-		{
-			const bool is_down = event.type == SDL_KEYDOWN;
 
-			switch (event.key.keysym.sym)
+		switch (event.caxis.axis)
+		{
+		case SDL_CONTROLLER_AXIS_LEFTX:
+			if (value < 0)
 			{
-			//case SDLK_w:
-			case SDLK_UP:
-				controller.dir_up = is_down ? 1.0f : 0;
-				break;
-			//case SDLK_s:
-			case SDLK_DOWN:
-				controller.dir_down = is_down ? 1.0f : 0;
-				break;
-			//case SDLK_a:
-			case SDLK_LEFT:
-				controller.dir_left = is_down ? 1.0f : 0;
-				break;
-			//case SDLK_d:
-			case SDLK_RIGHT:
-				controller.dir_right = is_down ? 1.0f : 0;
-				break;
-			case SDLK_SPACE:
-			case SDLK_p:
-				controller.button_start = is_down;
-				break;
-			case SDLK_ESCAPE:
-				controller.button_select = is_down;
-				break;
-			case SDLK_x:
-				controller.button_a = is_down;
-				break;
-			case SDLK_n:
-				controller.button_l = is_down;
-				break;
-			case SDLK_m:
-				draw_debug = !draw_debug;
-				break;
-			// case SDLK_w://todo remove
-			// 	if (state->currentLevel == state->levels + 3) {
-			// 		changeCurrentState(Ending);
-			// 	}
-			// 	else {
-			// 		changeCurrentState(Victory);
-			// 	}
-			// 	break;
+				controller.dir_left = -value;
+				controller.dir_right = 0;
 			}
-		}
-		else if (event.type == SDL_CONTROLLERAXISMOTION)
-		{
-			real32 value;
-			if (event.caxis.value > 0)
+			else
 			{
-				value = ((real32)event.caxis.value) / 32767.f;
+				controller.dir_right = value;
+				controller.dir_left = 0;
+			}
+			break;
+		case SDL_CONTROLLER_AXIS_LEFTY:
+			if (value < 0)
+			{
+				controller.dir_up = -value;
+				controller.dir_down = 0;
 			}
 			else
 			{
-				value = ((real32)event.caxis.value) / 32768.f;
+				controller.dir_down = value;
+				controller.dir_up = 0;
 			}
+			break;
+		}
+	}
+	else if (event.type == SDL_CONTROLLERBUTTONDOWN || event.type == SDL_CONTROLLERBUTTONUP)
+	{
+		const bool is_pressed = event.cbutton.state == SDL_PRESSED;
 
-			switch (event.caxis.axis)
+		switch (event.cbutton.button)
+		{
+		case SDL_CONTROLLER_BUTTON_DPAD_UP:
+			controller.dir_up = is_pressed ? 1.0f : 0;
+			break;
+		case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+			controller.dir_down = is_pressed ? 1.0f : 0;
+			break;
+		case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+			controller.dir_left = is_pressed ? 1.0f : 0;
+			break;
+		case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+			controller.dir_right = is_pressed ? 1.0f : 0;
+			break;
+		case SDL_CONTROLLER_BUTTON_A:
+			controller.button_a = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_B:
+			controller.button_b = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_X:
+			controller.button_c = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_Y:
+			controller.button_d = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+			controller.button_l = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+			controller.button_r = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_START:
+			controller.button_start = is_pressed;
+			break;
+		case SDL_CONTROLLER_BUTTON_BACK:
+			controller.button_select = is_pressed;
+			break;
+		default:
+			LogWarn("Unknown controller button pressed");
+		}
+	}
+	else if (event.type == SDL_MOUSEMOTION)
+	{
+		controller.mouseMoveX += event.motion.xrel;
+		controller.mouseMoveY += event.motion.yrel;
+	}
+	else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
+	{
+		switch (event.button.button)
+		{
+		case SDL_BUTTON_LEFT:
+			controller.button_mouse_l = (event.button.state == SDL_PRESSED);
+			break;
+		case SDL_BUTTON_RIGHT:
+			controller.button_mouse_r = (event.button.state == SDL_PRESSED);
+			break;
+		case SDL_BUTTON_MIDDLE:
+			controller.button_mouse_m = (event.button.state == SDL_PRESSED);
+			break;
+		default:
+			break;
+		}
+	}
+	else if (event.type == SDL_MOUSEWHEEL)
+	{
+		controller.mouseWheel += event.wheel.y;
+	}
+}
+
+void handleEvents(ControllerInput& controller)
+{
+	SDL_Event event;
+	while (SDL_PollEvent(&event))
+	{
+		if (event.type == SDL_QUIT)
+		{
+			closing = true;
+		}
+		else if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET)
+		{
+			text_cache.clear();
+			dynamic_resolution.reset();
+			frame_snapshot_valid = false;
+			if (event.type == SDL_RENDER_DEVICE_RESET && frame_snapshot_texture)
 			{
-			case SDL_CONTROLLER_AXIS_LEFTX:
-				if (value < 0)
-				{
-					controller.dir_left = -value;
-					controller.dir_right = 0;
-				}
-				else
-				{
-					controller.dir_right = value;
-					controller.dir_left = 0;
-				}
-				break;
-			case SDL_CONTROLLER_AXIS_LEFTY:
-				if (value < 0)
-				{
-					controller.dir_up = -value;
-					controller.dir_down = 0;
-				}
-				else
-				{
-					controller.dir_down = value;
-					controller.dir_up = 0;
-				}
-				break;
+				SDL_DestroyTexture(frame_snapshot_texture);
+				frame_snapshot_texture = NULL;
 			}
 		}
-		else if (event.type == SDL_CONTROLLERBUTTONDOWN || event.type == SDL_CONTROLLERBUTTONUP)
+		else if (event.type == SDL_CONTROLLERDEVICEADDED)
 		{
-			const bool is_pressed = event.cbutton.state == SDL_PRESSED;
-
-			switch (event.cbutton.button)
+			LogInfo("Controller added: %d\n", event.cdevice.which);
+			const int32 device_index = event.cdevice.which;
+			if (SDL_IsGameController(device_index))
 			{
-			case SDL_CONTROLLER_BUTTON_DPAD_UP:
-				controller.dir_up = is_pressed ? 1.0f : 0;
-				break;
-			case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
-				controller.dir_down = is_pressed ? 1.0f : 0;
-				break;
-			case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
-				controller.dir_left = is_pressed ? 1.0f : 0;
-				break;
-			case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
-				controller.dir_right = is_pressed ? 1.0f : 0;
-				break;
-			case SDL_CONTROLLER_BUTTON_A:
-				controller.button_a = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_B:
-				controller.button_b = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_X:
-				controller.button_c = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_Y:
-				controller.button_d = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
-				controller.button_l = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
-				controller.button_r = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_START:
-				controller.button_start = is_pressed;
-				break;
-			case SDL_CONTROLLER_BUTTON_BACK:
-				controller.button_select = is_pressed;
-				break;
-			default:
-				LogWarn("Unknown controller button pressed");
+				SDL_GameController* game_controller = SDL_GameControllerOpen(device_index);
 			}
 		}
-		else if (event.type == SDL_MOUSEMOTION)
+		else if (event.type == SDL_CONTROLLERDEVICEREMOVED)
 		{
-			controller.mouseMoveX += event.motion.xrel;
-			controller.mouseMoveY += event.motion.yrel;
+			LogInfo("Controller removed: %d\n", event.cdevice.which);
+			int32 instance_id = event.cdevice.which;
 		}
-		else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
+		else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat && event.key.keysym.sym == SDLK_m)
 		{
-			switch (event.button.button)
-			{
-			case SDL_BUTTON_LEFT:
-				controller.button_mouse_l = (event.button.state == SDL_PRESSED);
-				break;
-			case SDL_BUTTON_RIGHT:
-				controller.button_mouse_r = (event.button.state == SDL_PRESSED);
-				break;
-			case SDL_BUTTON_MIDDLE:
-				controller.button_mouse_m = (event.button.state == SDL_PRESSED);
-				break;
-			default:
-				break;
-			}
+			draw_debug = !draw_debug;
 		}
-		else if (event.type == SDL_MOUSEWHEEL)
+		else if (isInputEvent(event.type))
 		{
-			controller.mouseWheel += event.wheel.y;
+			input_queue.push(event);
 		}
 	}
+
+	input_queue.replay(controller, applyInputEvent);
 }
 
 static real32 SDLGetSecondsElapsed(uint64 old_counter, uint64 current_counter, uint64 perf_frequency)
@@ -282,11 +337,12 @@ SDL_Texture* win_screen_texture = NULL;
 void changeCurrentState(State new_state)
 {
 	LogDebug("Changing state from %d to %d", state->current_state, new_state);
+	frame_snapshot_valid = false;
 	if (state->current_state == Playing)
 	{
 		if (new_state == Paused)
 		{
-			Mix_VolumeMusic(music_volume / 2);
+			music_player.setVolume(music_volume / 2);
 		}
 		else if (new_state == Shaking)
 		{
@@ -294,33 +350,34 @@ void changeCurrentState(State new_state)
 		}
 		else if (new_state == Victory)
 		{
-			Mix_HaltMusic();
+			music_player.stop();
 			playSound(victory);
+			music_player.preload(MusicTrack::Level);
 		}
 		else if (new_state == MainMenu) {
-			Mix_HaltMusic();
-			Mix_PlayMusic(title_music, -1);
+			music_player.play(MusicTrack::Title);
 			
 			delete state;
 			state = new GameState();
 		}
 		else if (new_state == BossEntrance) {
-			Mix_HaltMusic();
+			music_player.stop(music_crossfade_ms);
+			music_player.preload(MusicTrack::Boss);
+			music_player.preload(MusicTrack::WinScreen);
 		}
 		else if (new_state == Ending) {
-			Mix_HaltMusic();
-			Mix_PlayMusic(winscreen_music, -1);
+			music_player.play(MusicTrack::WinScreen);
 		}
 	}
 	else if (state->current_state == Victory)
 	{
 		if (new_state == MainMenu)
 		{
-			Mix_PlayMusic(title_music, -1);
+			music_player.play(MusicTrack::Title, 0);
 		}
 		else if (new_state == Playing)
 		{
-			Mix_PlayMusic(level_music, -1);
+			music_player.play(MusicTrack::Level, 0);
 		}
 	}
 	else if (state->current_state == Dead)
@@ -335,28 +392,29 @@ void changeCurrentState(State new_state)
 	{
 		if (new_state == Playing)
 		{
-			Mix_VolumeMusic(music_volume);
+			music_player.setVolume(music_volume);
 		}
 	}
 	else if (state->current_state == MainMenu)
 	{
 		if (new_state == Controls)
 		{
-			Mix_HaltMusic();
+			music_player.stop();
+			music_player.preload(MusicTrack::Level);
 		}
 	}
 	else if (state->current_state == Controls)
 	{
 		if (new_state == Beginning)
 		{
-			Mix_PlayMusic(level_music, -1);
+			music_player.play(MusicTrack::Level, 0);
 		}
 	}
 	else if (state->current_state == GameOver)
 	{
 		if (new_state == MainMenu)
 		{
-			Mix_PlayMusic(title_music, -1);
+			music_player.play(MusicTrack::Title, 0);
 		}
 	}
 	else if (state->current_state == Shaking)
@@ -370,8 +428,7 @@ void changeCurrentState(State new_state)
 	{
 		if (new_state == MainMenu)
 		{
-			Mix_HaltMusic();
-			Mix_PlayMusic(title_music, -1);
+			music_player.play(MusicTrack::Title);
 			delete state;
 			state = new GameState();
 		}
@@ -380,7 +437,7 @@ void changeCurrentState(State new_state)
 	{
 		if (new_state == Playing)
 		{
-			Mix_PlayMusic(boss_music, -1);
+			music_player.play(MusicTrack::Boss, 0);
 			state->player.velocity = {0, 0};
 		}
 	}
@@ -390,7 +447,6 @@ void changeCurrentState(State new_state)
 
 void initialize(SDL_Renderer* renderer)
 {
-	frozen_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
 	overlay_texture = loadTexture(renderer, "overlay.png");
 	controls_texture = loadTexture(renderer, "controls.png");
 	title_bg_texture = loadTexture(renderer, "title_bg.png");
@@ -418,15 +474,12 @@ void initialize(SDL_Renderer* renderer)
 	enemy_boss_texture_smallclaw_normal = loadTexture(renderer, "boss_main_smallclaw.png");
 	enemy_boss_texture_spit = loadTexture(renderer, "boss_main_spit.png");
 
-	decor_texture_seaweed = loadTexture(renderer, "seaweed.png");
-	decor_texture_coral1 = loadTexture(renderer, "deco_coral1.png");
-	decor_texture_coral2 = loadTexture(renderer, "deco_coral2.png");
-	decor_texture_rock1 = loadTexture(renderer, "deco_rock1.png");
-	decor_texture_rock2 = loadTexture(renderer, "deco_rock2.png");
-	decor_texture_rock3 = loadTexture(renderer, "deco_rock3.png");
-	decor_texture_arrow_up = loadTexture(renderer, "arrow_up.png");
-	decor_texture_arrow_up_right = loadTexture(renderer, "arrow_up_right.png");
-	decor_texture_arrow_down_right = loadTexture(renderer, "arrow_down_right.png");
+	// Decor images come from the level palette, before any level is parsed
+	level_colors.load();
+	for (uint32 i = 0; i < level_colors.getDecorCount(); i++)
+	{
+		level_colors.setDecorTexture(i, loadTexture(renderer, level_colors.getDecorFile(i)));
+	}
 
 	diagonal_texture = loadTexture(renderer, "diagonal.png");
 	key_texture = loadTexture(renderer, "key.png");
@@ -449,15 +502,14 @@ void initialize(SDL_Renderer* renderer)
 	grampa_texture = loadTexture(renderer, "grampa_puffer.png");
 	stun_texture = loadTexture(renderer, "stun.png");
 
-	//Load music
-	title_music = Mix_LoadMUS("assets/menu.ogg");
-	level_music = Mix_LoadMUS("assets/level.ogg");
-	boss_music = Mix_LoadMUS("assets/boss.ogg");
-	winscreen_music = Mix_LoadMUS("assets/win_screen.ogg");
-	if (title_music == NULL)
-	{
-		LogError("Failed to load music! SDL_mixer Error: %s\n", Mix_GetError());
-	}
+	particle_texture_bubble1 = loadTexture(renderer, "bubble1.png");
+	particle_texture_bubble2 = loadTexture(renderer, "bubble2.png");
+	particle_texture_bubble3 = loadTexture(renderer, "bubble3.png");
+	particle_system.init(particle_texture_bubble1, particle_texture_bubble2, particle_texture_bubble3, tile1_texture_breakable);
+
+	//Load music in the background
+	music_player.init();
+	music_player.preload(MusicTrack::Title);
 
 	//Load sound effects
 	shoot = Mix_LoadWAV("assets/shoot.wav");
@@ -483,26 +535,22 @@ void initialize(SDL_Renderer* renderer)
 	}
 
 	SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+	dynamic_resolution.init(target_seconds_per_frame);
 
-	Mix_VolumeMusic(music_volume);
-	Mix_PlayMusic(title_music, -1);
+	music_player.setVolume(music_volume);
+	music_player.play(MusicTrack::Title, 0);
 
 	// Text
 	medium_font = FC_CreateFont();
 	large_font = FC_CreateFont();
 	large_blue_font = FC_CreateFont();
 	xlarge_font = FC_CreateFont();
-	// speech_font = FC_CreateFont();
-	FC_LoadFont(medium_font, renderer, "assets/Action_Man.ttf", 24*6, FC_MakeColor(255, 255, 255, 255),
-	            TTF_STYLE_NORMAL);
-	// FC_LoadFont(speech_font, renderer, "assets/Action_Man.ttf", 24*6, FC_MakeColor(255, 255, 255, 255),
-	//             TTF_STYLE_NORMAL);
-	FC_LoadFont(large_font, renderer, "assets/Action_Man.ttf", 48*6, FC_MakeColor(255, 255, 255, 255),
-	            TTF_STYLE_NORMAL);
-	FC_LoadFont(large_blue_font, renderer, "assets/Action_Man.ttf", 48*6, FC_MakeColor(57, 59, 116, 255),
-	            TTF_STYLE_NORMAL);
-	FC_LoadFont(xlarge_font, renderer, "assets/Action_Man.ttf", 72*6, FC_MakeColor(116, 0, 32, 255),
-	            TTF_STYLE_NORMAL);
+	speech_font = FC_CreateFont();
+	loadFont(medium_font, renderer, "assets/Action_Man.ttf", 24*6, FC_MakeColor(255, 255, 255, 255));
+	loadFont(speech_font, renderer, "assets/Action_Man.ttf", 20*6, FC_MakeColor(255, 255, 255, 255));
+	loadFont(large_font, renderer, "assets/Action_Man.ttf", 48*6, FC_MakeColor(255, 255, 255, 255));
+	loadFont(large_blue_font, renderer, "assets/Action_Man.ttf", 48*6, FC_MakeColor(57, 59, 116, 255));
+	loadFont(xlarge_font, renderer, "assets/Action_Man.ttf", 72*6, FC_MakeColor(116, 0, 32, 255));
 }
 
 inline bool handlePause(const ControllerInput* controller) {
@@ -517,6 +565,20 @@ inline bool handlePause(const ControllerInput* controller) {
 	return false;
 }
 
+// Farthest any enemy can see the player from
+constexpr real32 enemy_sight_distance = 1800;
+
+// Line of sight from every enemy that may think this frame to the player, before they think
+void updateEnemySight(const Rect2f& area)
+{
+	const Vector2f target = state->player.getCenter();
+	for (auto& enemy : state->enemies) {
+		const Vector2f center = enemy->getCenter();
+		enemy->playerInSight = !enemy->isDead && (target - center).getMagnitude() < enemy_sight_distance &&
+		                       enemy->getHitbox().collides(area) && !state->currentLevel->raycast(center, target);
+	}
+}
+
 void playingUpdate(const ControllerInput* controller, real32 time_delta)
 {
 	if (handlePause(controller)){
@@ -524,7 +586,10 @@ void playingUpdate(const ControllerInput* controller, real32 time_delta)
 	}
 
 	Player* player = &state->player;
-	
+
+	// Platforms first, so actors move from where they were pushed or carried to
+	state->updateMovingSolids(time_delta);
+
 	player->update(time_delta, controller);
 #if DEBUG
 	if (controller->button_l) {
@@ -554,28 +619,24 @@ void playingUpdate(const ControllerInput* controller, real32 time_delta)
         camera->y = state->currentLevel->height - camera->h;
     }
 
+	state->streamChunks(*camera);
+
+	// Once for all the chasers
+	state->flowField.update(*state->currentLevel, state->player.getCenter(), *camera, {enemy_fish_hit_rect.w, enemy_fish_hit_rect.h});
+
 	// Update stuff
 	Rect2f extendedCamera = *camera;
 	extendedCamera.x -= 200;
 	extendedCamera.y -= 200;
 	extendedCamera.w += 400;
 	extendedCamera.h += 400;
+	updateEnemySight(extendedCamera);
 	for (auto& enemy : state->enemies) {
 		if (!enemy->isDead && enemy->getHitbox().collides(extendedCamera)) {
 			enemy->think(time_delta);
 			enemy->update(time_delta, &enemy->input);
 		}
 	}
-	for (auto& decor : state->decors) {
-		if (decor->getHitbox().collides(extendedCamera)) {
-			decor->update(time_delta, 0);
-		}
-	}
-	for (auto& diagonal : state->diagonals) {
-		if (diagonal->getHitbox().collides(extendedCamera)) {
-			diagonal->update(time_delta, 0);
-		}
-	}
 	for (auto& button : state->buttons) {
 		if (button->getHitbox().collides(extendedCamera)) {
 			button->update(time_delta, 0);
@@ -586,6 +647,9 @@ void playingUpdate(const ControllerInput* controller, real32 time_delta)
 	state->heart.update(time_delta, 0);
 	state->grampa.update(time_delta, 0);
 
+	particle_system.spawnAmbientBubbles(*state->currentLevel, *camera, time_delta);
+	particle_system.update(time_delta);
+
 	if (!state->bossStarted && state->currentLevel == state->levels + 3 && state->player.position.x > 80 * 60) {
 		state->bossStarted = true;
 		changeCurrentState(State::BossEntrance);
@@ -596,6 +660,11 @@ void playingUpdate(const ControllerInput* controller, real32 time_delta)
 		auto& enemy = state->enemies[i];
 		if (enemy->isDead){
 			LogWarn("Cleaning dead enemy");
+			if (enemy->spawnerIndex >= 0) {
+				EnemySpawner& spawner = state->currentLevel->enemySpawners[enemy->spawnerIndex];
+				spawner.alive = false;
+				spawner.defeated = true;
+			}
 			deleteFromVector(state->AllActors, (Actor*)enemy.get());
 			state->enemies.erase(state->enemies.begin() + i);
 		}
@@ -613,36 +682,43 @@ void playingUpdate(const ControllerInput* controller, real32 time_delta)
 	state->play_time_passed += time_delta;
 }
 
+// Screen space rect moved by the current screen shake
+inline SDL_Rect shakeRect(int32 x, int32 y, int32 w, int32 h) {
+	return {x + (int32)state->screenShake.x, y + (int32)state->screenShake.y, w, h};
+}
+
 inline void drawHUD() {
 	// Hearts
 	const SDL_Point heartPos = {50, 35};
 	for (int32 i=0; i<state->player.health; i++) {
-		SDL_Rect dstRect = {heartPos.x + i*135, heartPos.y, 100, 100};
+		SDL_Rect dstRect = shakeRect(heartPos.x + i*135, heartPos.y, 100, 100);
 		SDL_RenderCopy(renderer, heart_texture, 0, &dstRect);
 	}
 
 	// Cooldown
 	const int32 cooldownLength = 370;
-	SDL_Rect rectBg = {50, 150, cooldownLength, 50};
-	SDL_Rect rectFg = {50, 150, (int)(cooldownLength * (state->player.puffMaxCooldown - state->player.puffCooldown) / state->player.puffMaxCooldown), 50};
+	SDL_Rect rectBg = shakeRect(50, 150, cooldownLength, 50);
+	SDL_Rect rectFg = shakeRect(50, 150, (int)(cooldownLength * (state->player.puffMaxCooldown - state->player.puffCooldown) / state->player.puffMaxCooldown), 50);
 	SDL_SetRenderDrawColor(renderer, 70, 0, 0, 255);
 	SDL_RenderFillRect(renderer, &rectBg);
 	if (rectFg.w > 0) {
 		SDL_SetRenderDrawColor(renderer, 150, 255, 30, 255);
 		SDL_RenderFillRect(renderer, &rectFg);
 	}
+}
 
+// Drawn over the frozen gameplay frame
+inline void drawOverlays() {
 	// Pause overlay
 	if (state->current_state == Paused)
 	{
 		SDL_RenderCopy(renderer, overlay_texture, 0, 0);
 		SDL_Rect controls_rect = {140*6, 100*6, 360*6, 180*6};
 		SDL_RenderCopy(renderer, controls_texture, 0, &controls_rect);
-		SDL_RenderPresent(renderer);
 	}
 	else if (state->current_state == Dead) {
-		FC_Draw(xlarge_font, renderer, 300, 150, "You Sleep");
-		FC_Draw(xlarge_font, renderer, 200, 600, "with the Fishes");
+		text_cache.draw(xlarge_font, renderer, 300, 150, "You Sleep");
+		text_cache.draw(xlarge_font, renderer, 200, 600, "with the Fishes");
 	}
 	
 #if DEBUG
@@ -654,12 +730,19 @@ inline void drawHUD() {
 
 void playingDraw()
 {
-	SDL_RenderCopy(renderer, level_bg_texture, 0, 0);
+	dynamic_resolution.beginScene(renderer);
+
+	const SDL_Rect bg_rect = shakeRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+	SDL_RenderCopy(renderer, level_bg_texture, 0, &bg_rect);
 
 	for (Solid& solid : state->currentLevel->solids) {
-		solid.render(renderer);
+		if (!solid.broken) {
+			solid.render(renderer);
+		}
 	}
 
+	particle_system.render(renderer, state->camera, state->screenShake);
+
 	Rect2f extendedCamera = state->camera;
 	extendedCamera.x -= 200;
 	extendedCamera.y -= 200;
@@ -673,21 +756,26 @@ void playingDraw()
 				// Draw the hitboxes
 				SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 				SDL_Rect rect = actor->getHitbox().toSDLRect();
-				rect.x -= state->camera.x;
-				rect.y -= state->camera.y;
+				rect.x += state->screenShake.x - state->camera.x;
+				rect.y += state->screenShake.y - state->camera.y;
 				SDL_SetRenderDrawColor(renderer, 255, 0, 0, 85);
 				SDL_RenderFillRect(renderer, &rect);
 
 				EnemyBoss* boss = dynamic_cast<EnemyBoss*>(actor);
 				if (boss) {
-					for (Rect2f rect : boss->clawHitRects) {
-						Vector2f center = rect.getCenter();
-						Vector2f rotated = rotatePoint({center.x+ boss->claw_normal_offset.x + boss->position.x, center.y + boss->claw_normal_offset.y + boss->position.y}, {boss->claw_joint_offset.x + boss->position.x, boss->claw_joint_offset.y + boss->position.y}, (boss->clawAngle + boss->clawAngleWave)*0.75);
-						rect.x = rotated.x - rect.w/2 - state->camera.x;
-						rect.y = rotated.y - rect.h/2 - state->camera.y;
-						SDL_Rect sdl_rect = rect.toSDLRect();
-						SDL_SetRenderDrawColor(renderer, 255, 0, 0, 85);
-						SDL_RenderFillRect(renderer, &sdl_rect);
+					// The same boxes the boss collides with this frame
+					const Vector2f view_offset = state->screenShake - Vector2f(state->camera.x, state->camera.y);
+					const int32 quad_indices[] = {0, 1, 2, 0, 2, 3};
+					for (const OrientedRect2f& hitbox : boss->clawHitboxes) {
+						Vector2f corners[4];
+						hitbox.getCorners(corners);
+						SDL_Vertex vertices[4];
+						for (int32 i = 0; i < 4; ++i) {
+							vertices[i].position = {corners[i].x + view_offset.x, corners[i].y + view_offset.y};
+							vertices[i].color = {255, 0, 0, 85};
+							vertices[i].tex_coord = {0, 0};
+						}
+						SDL_RenderGeometry(renderer, NULL, vertices, 4, quad_indices, 6);
 					}
 				}
 
@@ -697,9 +785,58 @@ void playingDraw()
 		}
 	}
 
+	dynamic_resolution.endScene(renderer);
 	drawHUD();
 }
 
+inline bool isWorldFrozen(State s)
+{
+	return s == Paused || s == Dead || s == Victory || s == Ending || s == GameOver;
+}
+
+// Draws the world once into the snapshot and then only copies it, the world does not change in these states
+void frozenDraw()
+{
+	int32 output_width, output_height;
+	SDL_GetRendererOutputSize(renderer, &output_width, &output_height);
+	if (frame_snapshot_texture)
+	{
+		int32 snapshot_width, snapshot_height;
+		SDL_QueryTexture(frame_snapshot_texture, NULL, NULL, &snapshot_width, &snapshot_height);
+		if (snapshot_width != output_width || snapshot_height != output_height)
+		{
+			SDL_DestroyTexture(frame_snapshot_texture);
+			frame_snapshot_texture = NULL;
+		}
+	}
+	if (!frame_snapshot_texture && SDL_RenderTargetSupported(renderer))
+	{
+		frame_snapshot_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, output_width, output_height);
+		frame_snapshot_valid = false;
+	}
+	if (!frame_snapshot_texture)
+	{
+		playingDraw();
+		drawOverlays();
+		return;
+	}
+
+	if (!frame_snapshot_valid)
+	{
+		SDL_Texture* previous_target = SDL_GetRenderTarget(renderer);
+		SDL_SetRenderTarget(renderer, frame_snapshot_texture);
+		SDL_RenderSetScale(renderer, (real32)output_width / SCREEN_WIDTH, (real32)output_height / SCREEN_HEIGHT);
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+		SDL_RenderClear(renderer);
+		playingDraw();
+		SDL_SetRenderTarget(renderer, previous_target);
+		frame_snapshot_valid = true;
+	}
+
+	SDL_RenderCopy(renderer, frame_snapshot_texture, 0, 0);
+	drawOverlays();
+}
+
 void update(const ControllerInput* controller, real32 time_delta) {
 	bool pausePress = false;
 	real32 speedMult = 1.f;
@@ -722,7 +859,7 @@ void update(const ControllerInput* controller, real32 time_delta) {
 			closing = true;
 		}
 #endif
-		state->main_menu_frames++;
+		state->main_menu_time += time_delta;
 		break;
 	case Controls:
 		if (controller->button_start && state->controls_frames > 10)
@@ -826,6 +963,7 @@ void update(const ControllerInput* controller, real32 time_delta) {
 		if (state->camera.x + state->camera.w < state->currentLevel->width) {
 			// Move the camera into place
 			state->camera.x += 350.f * time_delta * speedMult;
+			state->streamChunks(state->camera);
 		}
 		else {
 			int32& brickState = state->boss_brick_state;
@@ -860,21 +998,65 @@ void update(const ControllerInput* controller, real32 time_delta) {
 	}
 }
 
+/// Starts drawing a frame of the shake. The render target is only made the first time it is used, it takes 33 MB.
+static void beginShake(ShakeMode mode, int32 frame)
+{
+	if (mode == ShakeMode::RenderTarget)
+	{
+		if (!frozen_texture)
+		{
+			frozen_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+		}
+		SDL_SetRenderTarget(renderer, frozen_texture);
+	}
+	else
+	{
+		state->screenShake = {(real32)shake_xs[frame], (real32)shake_ys[frame]};
+	}
+}
+
+/// Finishes the shaken frame, it is ready to present afterwards
+static void endShake(ShakeMode mode, int32 frame)
+{
+	if (mode == ShakeMode::RenderTarget)
+	{
+		SDL_SetRenderTarget(renderer, 0);
+		const SDL_Rect frame_rect = {shake_xs[frame], shake_ys[frame], SCREEN_WIDTH, SCREEN_HEIGHT};
+		SDL_RenderCopy(renderer, frozen_texture, 0, &frame_rect);
+	}
+	else
+	{
+		state->screenShake = {0, 0};
+	}
+}
+
+inline void presentFrame()
+{
+	frame_pacer.waitForDeadline();
+	SDL_RenderPresent(renderer);
+	frame_pacer.onPresent();
+	input_queue.onPresent();
+}
+
 void draw() {
+#if DEBUG
+	const uint64 draw_start = SDL_GetPerformanceCounter();
+#endif
+	const bool shaking = state->current_state == Shaking;
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 	SDL_RenderClear(renderer);
-	if (state->current_state == Shaking)
+	if (shaking)
 	{
-		SDL_SetRenderTarget(renderer, frozen_texture);
+		beginShake(shake_mode, state->shaking_frames);
 	}
 
 	if (state->current_state == MainMenu)
 	{
 		// Main menu
 		SDL_RenderCopy(renderer, title_bg_texture, 0, 0);
-		if (state->main_menu_frames/30 % 2 == 0)
+		if (fmodf(state->main_menu_time, 1.f) < 0.5f)
 		{
-			FC_Draw(medium_font, renderer, 180*6, 275*6, "Press Space to Start");
+			text_cache.draw(medium_font, renderer, 180*6, 275*6, "Press Space to Start");
 		}
 	}
 	else if (state->current_state == Controls)
@@ -883,9 +1065,14 @@ void draw() {
 		SDL_Rect controls_rect = {140*6, 100*6, 360*6, 180*6};
 		SDL_RenderCopy(renderer, controls_texture, 0, &controls_rect);
 	}
+	else if (isWorldFrozen(state->current_state))
+	{
+		frozenDraw();
+	}
 	else
 	{
 		playingDraw();
+		drawOverlays();
 	}
 	
 	if (state->current_state == Ending) {
@@ -901,28 +1088,49 @@ void draw() {
 			SDL_RenderCopyF(renderer, win_screen_texture, 0, 0);
 		}
 		if (state->ending_time > 5.f) {
-			renderOutlinedText(large_blue_font, renderer, 200, 300, "You have saved the ocean!", 5, {57, 59, 116, 255}, {255, 255, 255, 255});
+			text_cache.draw(large_blue_font, renderer, 200, 300, "You have saved the ocean!", 5, {57, 59, 116, 255}, {255, 255, 255, 255});
 		}
 		if (state->ending_time > 7.f) {
-			renderOutlinedText(large_blue_font, renderer, 300, 1700, "Thank you for playing!", 5, {57, 59, 116, 255}, {255, 255, 255, 255});
+			text_cache.draw(large_blue_font, renderer, 300, 1700, "Thank you for playing!", 5, {57, 59, 116, 255}, {255, 255, 255, 255});
 		}
 	}
 
+	draw_work_end_counter = SDL_GetPerformanceCounter();
+
 	// Screen Shake
-	if (state->current_state == Shaking)
+	if (shaking)
 	{
-		SDL_SetRenderTarget(renderer, 0);
-		const SDL_Rect frame_rect = { shake_xs[state->shaking_frames], shake_ys[state->shaking_frames], SCREEN_WIDTH, SCREEN_HEIGHT};
-		SDL_RenderCopy(renderer, frozen_texture, 0, &frame_rect);
-		SDL_RenderPresent(renderer);
+		endShake(shake_mode, state->shaking_frames);
+		presentFrame();
 
 		state->shaking_frames++;
 	}
 	else
 	{
-		SDL_RenderPresent(renderer);
+		presentFrame();
 	}
 
+#if DEBUG
+	const real64 draw_ms = 1000.0 * SDLGetSecondsElapsed(draw_start, SDL_GetPerformanceCounter(), perf_frequency);
+	if (shaking)
+	{
+		draw_cost_stats.shakeMs += draw_ms;
+		draw_cost_stats.shakeFrames++;
+	}
+	else if (state->current_state == Playing)
+	{
+		draw_cost_stats.normalMs += draw_ms;
+		draw_cost_stats.normalFrames++;
+		if (draw_cost_stats.shakeFrames > 0)
+		{
+			LogInfo("draw(): %.3f ms per shake frame (%u frames), %.3f ms per normal frame (%u frames), render target shake: %d",
+			        draw_cost_stats.shakeMs / draw_cost_stats.shakeFrames, draw_cost_stats.shakeFrames,
+			        draw_cost_stats.normalMs / draw_cost_stats.normalFrames, draw_cost_stats.normalFrames, shake_mode == ShakeMode::RenderTarget);
+			draw_cost_stats = {};
+		}
+	}
+#endif
+
 	if (state->current_state != Paused && state->current_state != Shaking)
 	{
 		static uint32 non_paused_frame_count = 0;
@@ -936,11 +1144,48 @@ void updateAndDraw(const ControllerInput* controller, real32 time_delta)
 	draw();
 }
 
+// How long the loop may block waiting for input, 0 while something on screen animates
+int32 getIdleTimeoutMs()
+{
+	const int32 max_idle_ms = 250;
+	// A held back release has to reach the next update, or a tap would read as held while waiting
+	if (input_queue.hasPending())
+	{
+		return 0;
+	}
+	switch (state->current_state)
+	{
+	case Paused:
+	case GameOver:
+		return max_idle_ms;
+	case Controls:
+		return state->controls_frames > 10 ? max_idle_ms : 0;
+	case Ending:
+		return state->ending_time > 7.f ? max_idle_ms : 0;
+	case MainMenu:
+		// Wake up for the next blink of the prompt, but not later than the others
+		return MIN(max_idle_ms, MAX(1, (int32)((0.5f - fmodf(state->main_menu_time, 0.5f)) * 1000)));
+	default:
+		return 0;
+	}
+}
+
 void main_loop() {
-	static uint64 last_counter = SDL_GetPerformanceCounter();
-	static uint64 update_counter = last_counter;
+	static uint64 update_counter = SDL_GetPerformanceCounter();
 	static ControllerInput controller = {};
 
+#ifndef __EMSCRIPTEN__
+	// Nothing animates, so sleep until input arrives instead of spinning at 60 Hz
+	const int32 idle_timeout = getIdleTimeoutMs();
+	if (idle_timeout > 0)
+	{
+		SDL_WaitEventTimeout(NULL, idle_timeout);
+		frame_pacer.markIdle();
+	}
+#endif
+
+	// Scratch of the last tick is gone from here on
+	frame_arena.reset();
 	handleEvents(controller);
 
 	uint64 new_update_counter = SDL_GetPerformanceCounter();
@@ -948,43 +1193,27 @@ void main_loop() {
 	update_counter = new_update_counter;
 
 	updateAndDraw(&controller, time_delta);
-
-#ifndef __EMSCRIPTEN__
-	const real32 seconds_elapsed = SDLGetSecondsElapsed(last_counter, SDL_GetPerformanceCounter(), perf_frequency);
-	if (seconds_elapsed < target_seconds_per_frame)
+	music_player.update();
+	if (state->current_state == Playing)
 	{
-		const int32 time_to_sleep = (int32)((target_seconds_per_frame - seconds_elapsed) * 1000) - 1;
-		if (time_to_sleep > 0)
-		{
-			SDL_Delay(time_to_sleep);
-		}
-		//SDL_assert(SDLGetSecondsElapsed(last_counter, SDL_GetPerformanceCounter(), perf_frequency) < target_seconds_per_frame);
-		while (SDLGetSecondsElapsed(last_counter, SDL_GetPerformanceCounter(), perf_frequency) <
-			target_seconds_per_frame)
-		{
-			// Waiting...
-		}
+		dynamic_resolution.recordFrame(time_delta, SDLGetSecondsElapsed(new_update_counter, draw_work_end_counter, perf_frequency));
 	}
-#endif
-
-	uint64 end_counter = SDL_GetPerformanceCounter();
 
 #if DEBUG
 	if (frame_count % 256 == 0)
 	{
-		uint64 counter_elapsed = end_counter - last_counter;
-		real64 ms_per_frame = (((1000.0f * (real64)counter_elapsed) / (real64)perf_frequency));
-		real64 fps = (real64)perf_frequency / (real64)counter_elapsed;
-		printf("%.02f ms/f, %.02f f/s \n", ms_per_frame, fps);
+		frame_pacer.logStats();
+		input_queue.logStats();
+		frame_arena.logStats();
 	}
 #endif
-	last_counter = end_counter;
 
 	if (closing) {
 #ifdef __EMSCRIPTEN__
 		changeCurrentState(MainMenu);
 		closing = false;
 #else
+		music_player.shutdown();
 		exit(0);
 #endif
 	}
@@ -992,6 +1221,138 @@ void main_loop() {
 	frame_count++;
 }
 
+#ifndef __EMSCRIPTEN__
+/// Plays one level image, or each level of a list file, for a number of frames with a scripted input and prints a
+/// CSV row per level. The paths are relative to the working directory, levels from tools/level_gen work as they are.
+int32 runLevelBenchmark(const std::string& path, int32 frames)
+{
+	std::vector<std::string> levelPaths;
+	if (path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0) {
+		std::ifstream list(path);
+		std::string line;
+		while (std::getline(list, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (!line.empty()) {
+				levelPaths.push_back(line);
+			}
+		}
+	}
+	else {
+		levelPaths.push_back(path);
+	}
+	if (levelPaths.empty()) {
+		LogError("No levels to benchmark in %s", path.c_str());
+		return 1;
+	}
+
+	// Nothing else may touch the levels while the benchmark reloads one
+	state->waitForLevel(state->levels[3]);
+	frame_pacer.setMode(renderer, FramePacing::Uncapped);
+	Level& level = state->levels[0];
+	std::mt19937 queryRng(1234);
+
+	printf("level,cells,tiles,spawners,load_ms,collide_ns,update_mean_ms,update_p95_ms,draw_mean_ms,draw_p95_ms,"
+	       "shake_offset_mean_ms,shake_target_mean_ms\n");
+	for (const std::string& levelPath : levelPaths) {
+		// Level::load looks in assets/. Each level is benchmarked once, the cache only keeps the game's levels.
+		uint64 start = SDL_GetPerformanceCounter();
+		level.load("../" + levelPath);
+		const real64 loadMs = 1000.0 * SDLGetSecondsElapsed(start, SDL_GetPerformanceCounter(), perf_frequency);
+		level_cache.remove("../" + levelPath);
+		if (!level.loaded || level.gridWidth == 0) {
+			continue;
+		}
+
+		state->currentLevel = &level;
+		state->reset();
+		state->current_state = Playing;
+
+		int32 tiles = 0;
+		for (const uint8 tile : level.tileCells) {
+			tiles += tile != (uint8)TileKind::None;
+		}
+
+		// Collision queries over the whole level, most land away from the chunks that are loaded
+		const int32 queries = 100000;
+		std::uniform_real_distribution<real32> xDist(0, (real32)level.width);
+		std::uniform_real_distribution<real32> yDist(0, (real32)level.height);
+		int32 hits = 0;
+		// collideAt warns on every hit, which would time the console instead of the query
+		const SDL_LogPriority logPriority = SDL_LogGetPriority(SDL_LOG_CATEGORY_APPLICATION);
+		SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_ERROR);
+		start = SDL_GetPerformanceCounter();
+		for (int32 i = 0; i < queries; ++i) {
+			hits += state->player.collideAt(&level, {xDist(queryRng), yDist(queryRng)}) != nullptr;
+		}
+		const real64 collideNs = 1e9 * SDLGetSecondsElapsed(start, SDL_GetPerformanceCounter(), perf_frequency) / queries;
+		SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, logPriority);
+
+		// Swims right and zigzags, without dying or leaving through the door
+		TimingHistory updateTimes;
+		TimingHistory drawTimes;
+		ControllerInput controller = {};
+		for (int32 frame = 0; frame < frames; ++frame) {
+			const bool goingUp = (frame / 60) % 2 == 0;
+			controller.dir_right = 1;
+			controller.dir_up = goingUp ? 1.f : 0.f;
+			controller.dir_down = goingUp ? 0.f : 1.f;
+			state->player.invulTime = 1;
+			state->key.holder = nullptr;
+			frame_arena.reset();
+
+			const uint64 updateStart = SDL_GetPerformanceCounter();
+			playingUpdate(&controller, target_seconds_per_frame);
+			const uint64 drawStart = SDL_GetPerformanceCounter();
+			playingDraw();
+			SDL_RenderPresent(renderer);
+			const uint64 drawEnd = SDL_GetPerformanceCounter();
+			updateTimes.add((real32)(1000.0 * SDLGetSecondsElapsed(updateStart, drawStart, perf_frequency)));
+			drawTimes.add((real32)(1000.0 * SDLGetSecondsElapsed(drawStart, drawEnd, perf_frequency)));
+
+			if (state->current_state != Playing) {
+				// Squished by a moving block
+				state->player.isDead = false;
+				state->player.dyingTime = 0;
+				state->player.visible = true;
+				state->current_state = Playing;
+			}
+			SDL_PumpEvents();
+		}
+
+		// The same frame drawn shaken both ways, from the start of the shake to the present
+		real64 shakeMeanMs[2] = {};
+		const ShakeMode shakeModes[2] = {ShakeMode::Offset, ShakeMode::RenderTarget};
+		const int32 shakeFrames = (int32)(sizeof(shake_xs) / sizeof(shake_xs[0]));
+		for (int32 mode = 0; mode < 2; ++mode) {
+			TimingHistory shakeTimes;
+			for (int32 frame = 0; frame < frames; ++frame) {
+				const uint64 shakeStart = SDL_GetPerformanceCounter();
+				SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+				SDL_RenderClear(renderer);
+				beginShake(shakeModes[mode], frame % shakeFrames);
+				playingDraw();
+				endShake(shakeModes[mode], frame % shakeFrames);
+				SDL_RenderPresent(renderer);
+				shakeTimes.add((real32)(1000.0 * SDLGetSecondsElapsed(shakeStart, SDL_GetPerformanceCounter(), perf_frequency)));
+				SDL_PumpEvents();
+			}
+			shakeMeanMs[mode] = shakeTimes.summarize().meanMs;
+		}
+
+		const TimingSummary update = updateTimes.summarize();
+		const TimingSummary draw = drawTimes.summarize();
+		printf("%s,%d,%d,%zu,%.2f,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", levelPath.c_str(), level.gridWidth * level.gridHeight, tiles,
+		       level.enemySpawners.size(), loadMs, collideNs, update.meanMs, update.p95Ms, draw.meanMs, draw.p95Ms,
+		       shakeMeanMs[0], shakeMeanMs[1]);
+		fflush(stdout);
+		LogDebug("%d of %d queries hit", hits, queries);
+	}
+	return 0;
+}
+#endif
+
 int main(int argc, char** argv) {
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER) != 0) {
 		std::cout << "SDL_Init Error: " << SDL_GetError() << std::endl;
@@ -1026,6 +1387,33 @@ screen_physical_height = 1080;
 
 	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
+	// --pacing=vsync|hybrid|uncapped, picked from the display refresh rate otherwise
+	FramePacing pacing = FramePacing::Auto;
+	// --shake=offset|target, how shaken frames are drawn
+	// --bench=<level png or list of them> [--bench-frames=N] prints timings per level and exits
+	std::string bench_path;
+	int32 bench_frames = timing_history_size;
+	for (int32 i = 1; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--pacing=", 9) == 0)
+		{
+			pacing = parseFramePacing(argv[i] + 9);
+		}
+		else if (strncmp(argv[i], "--shake=", 8) == 0)
+		{
+			shake_mode = strcmp(argv[i] + 8, "target") == 0 ? ShakeMode::RenderTarget : ShakeMode::Offset;
+		}
+		else if (strncmp(argv[i], "--bench=", 8) == 0)
+		{
+			bench_path = argv[i] + 8;
+		}
+		else if (strncmp(argv[i], "--bench-frames=", 15) == 0)
+		{
+			bench_frames = MAX(1, atoi(argv[i] + 15));
+		}
+	}
+	frame_pacer.init(window, renderer, pacing, target_seconds_per_frame);
+
 	SDLInitGamepads();
 
 	if (IMG_Init(IMG_INIT_PNG) == 0) {
@@ -1042,6 +1430,14 @@ screen_physical_height = 1080;
 
 	initialize(renderer);
 	state = new GameState();
+#ifndef __EMSCRIPTEN__
+	if (!bench_path.empty())
+	{
+		const int32 result = runLevelBenchmark(bench_path, bench_frames);
+		music_player.shutdown();
+		return result;
+	}
+#endif
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(main_loop, 0, 1);
 #else
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <SDL.h>
+#include "definitions.h"
+#include "timing_history.h"
+
+inline bool isInputEvent(uint32 type)
+{
+	return type == SDL_KEYDOWN || type == SDL_KEYUP ||
+	       type == SDL_CONTROLLERAXISMOTION || type == SDL_CONTROLLERBUTTONDOWN || type == SDL_CONTROLLERBUTTONUP ||
+	       type == SDL_MOUSEMOTION || type == SDL_MOUSEBUTTONDOWN || type == SDL_MOUSEBUTTONUP || type == SDL_MOUSEWHEEL;
+}
+
+struct TimedInputEvent
+{
+	SDL_Event event;
+	// When the event was taken off the SDL queue, event.common.timestamp is when SDL queued it
+	uint64 pollCounter;
+	uint32 pollTicks;
+};
+
+/// Input events in the order they arrived, replayed into the controller right before the update.
+/// A release whose press arrived in the same frame is held back to the next update, so taps
+/// shorter than a frame still reach the game. Also measures how long input takes to be presented.
+class InputQueue
+{
+public:
+	void push(const SDL_Event& event)
+	{
+		pending.push_back({event, SDL_GetPerformanceCounter(), SDL_GetTicks()});
+	}
+
+	/// apply(ControllerInput&, const SDL_Event&) must only change the controller, it can be called on a copy
+	template <typename ApplyFunction>
+	void replay(ControllerInput& controller, ApplyFunction apply)
+	{
+		const ControllerInput frameStart = controller;
+		size_t consumed = 0;
+		for (; consumed < pending.size(); ++consumed)
+		{
+			ControllerInput next = controller;
+			apply(next, pending[consumed].event);
+			if (endsTap(frameStart, controller, next))
+			{
+				break;
+			}
+			controller = next;
+			noteApplied(pending[consumed]);
+		}
+		pending.erase(pending.begin(), pending.begin() + consumed);
+	}
+
+	/// Events held back for the next update
+	inline bool hasPending() const
+	{
+		return !pending.empty();
+	}
+
+	/// Call right after presenting the frame that was simulated with the replayed input
+	void onPresent()
+	{
+		if (!frameHasInput)
+		{
+			return;
+		}
+		const uint64 now = SDL_GetPerformanceCounter();
+		lastLatencyMs = (real32)(1000.0 * (real64)(now - oldestEventCounter) / SDL_GetPerformanceFrequency());
+		latencies.add(lastLatencyMs);
+		frameHasInput = false;
+	}
+
+	/// Input to present time of the last frame that had input, in milliseconds
+	inline real32 getLastLatencyMs() const
+	{
+		return lastLatencyMs;
+	}
+
+	inline TimingSummary getLatencyStats() const
+	{
+		return latencies.summarize();
+	}
+
+	void logStats() const
+	{
+#if DEBUG
+		const TimingSummary stats = latencies.summarize();
+		LogInfo("Input to present (%u frames): mean %.2f ms, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f",
+		        stats.sampleCount, stats.meanMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs);
+#endif
+	}
+
+private:
+	static bool endsTap(const ControllerInput& frameStart, const ControllerInput& current, const ControllerInput& next)
+	{
+		static constexpr bool ControllerInput::* buttons[] = {
+			&ControllerInput::button_mouse_l, &ControllerInput::button_mouse_r, &ControllerInput::button_mouse_m,
+			&ControllerInput::button_a, &ControllerInput::button_b, &ControllerInput::button_c, &ControllerInput::button_d,
+			&ControllerInput::button_l, &ControllerInput::button_r, &ControllerInput::button_l2, &ControllerInput::button_r2,
+			&ControllerInput::button_select, &ControllerInput::button_start,
+		};
+		static constexpr real32 ControllerInput::* directions[] = {
+			&ControllerInput::dir_left, &ControllerInput::dir_right, &ControllerInput::dir_up, &ControllerInput::dir_down,
+		};
+		for (const auto button : buttons)
+		{
+			if (!(frameStart.*button) && current.*button && !(next.*button))
+			{
+				return true;
+			}
+		}
+		for (const auto direction : directions)
+		{
+			if (frameStart.*direction == 0 && current.*direction != 0 && next.*direction == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void noteApplied(const TimedInputEvent& input)
+	{
+		// SDL timestamps are in whole milliseconds, move the poll time back by the time spent in the SDL queue
+		const uint32 queuedMs = input.pollTicks > input.event.common.timestamp ? input.pollTicks - input.event.common.timestamp : 0;
+		const uint64 queuedCounts = queuedMs * SDL_GetPerformanceFrequency() / 1000;
+		const uint64 eventCounter = input.pollCounter > queuedCounts ? input.pollCounter - queuedCounts : 0;
+		if (!frameHasInput || eventCounter < oldestEventCounter)
+		{
+			oldestEventCounter = eventCounter;
+		}
+		frameHasInput = true;
+	}
+
+	std::vector<TimedInputEvent> pending;
+	bool frameHasInput = false;
+	uint64 oldestEventCounter = 0;
+	real32 lastLatencyMs = 0;
+	TimingHistory latencies;
+};
+
+InputQueue input_queue;
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bytes in one block of a level arena, bigger objects get a block of their own
+constexpr size_t level_arena_block_size = 64 * 1024;
+
+class LevelArena;
+
+/// Destroys an object made by LevelArena::make and gives its memory to the next object of the same size.
+/// The object must be at the start of its allocation, which holds for the single inheritance actors.
+struct LevelArenaDeleter
+{
+	LevelArena* arena = nullptr;
+	size_t size = 0;
+
+	template <typename T>
+	void operator()(T* object) const;
+};
+
+template <typename T>
+using LevelPtr = std::unique_ptr<T, LevelArenaDeleter>;
+
+/// Region for the objects of one level instance: enemies, bubbles, decors, diagonals and buttons. They sit next to
+/// each other in a few large blocks instead of all over the heap. Objects destroyed while playing, like enemies
+/// leaving with their chunk, leave their memory to the next object of that size. release() drops everything at once
+/// when the level starts over, and the blocks are kept for the next level.
+class LevelArena
+{
+public:
+	template <typename T, typename... Args>
+	LevelPtr<T> make(Args&&... args)
+	{
+		void* memory = allocate(sizeof(T), alignof(T));
+		T* object = new (memory) T(std::forward<Args>(args)...);
+		return LevelPtr<T>(object, LevelArenaDeleter{this, sizeof(T)});
+	}
+
+	void* allocate(size_t size, size_t alignment)
+	{
+		liveObjects++;
+		auto freeList = freeSlots.find(size);
+		if (freeList != freeSlots.end() && !freeList->second.empty())
+		{
+			void* memory = freeList->second.back();
+			freeList->second.pop_back();
+			return memory;
+		}
+
+		size_t offset = (blockOffset + alignment - 1) & ~(alignment - 1);
+		if (blocks.empty() || offset + size > blocks[currentBlock].size)
+		{
+			if (!blocks.empty())
+			{
+				currentBlock++;
+			}
+			if (currentBlock == blocks.size() || blocks[currentBlock].size < size)
+			{
+				const size_t blockSize = size > level_arena_block_size ? size : level_arena_block_size;
+				blocks.insert(blocks.begin() + currentBlock, {std::make_unique<uint8_t[]>(blockSize), blockSize});
+			}
+			offset = 0;
+		}
+		blockOffset = offset + size;
+		usedBytes += size;
+		return blocks[currentBlock].data.get() + offset;
+	}
+
+	void recycle(void* memory, size_t size)
+	{
+		liveObjects--;
+		freeSlots[size].push_back(memory);
+	}
+
+	/// Forgets every object at once, all of them must have been destroyed
+	void release()
+	{
+		currentBlock = 0;
+		blockOffset = 0;
+		usedBytes = 0;
+		freeSlots.clear();
+	}
+
+	/// Bytes handed out since the last release, recycled slots count once
+	inline size_t getUsedBytes() const
+	{
+		return usedBytes;
+	}
+
+	inline size_t getCapacity() const
+	{
+		size_t capacity = 0;
+		for (const Block& block : blocks)
+		{
+			capacity += block.size;
+		}
+		return capacity;
+	}
+
+	inline size_t getLiveObjects() const
+	{
+		return liveObjects;
+	}
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+		size_t size = 0;
+	};
+
+	std::vector<Block> blocks;
+	size_t currentBlock = 0;
+	size_t blockOffset = 0;
+	size_t usedBytes = 0;
+	size_t liveObjects = 0;
+	// Memory of destroyed objects by size, there are only a few actor types
+	std::unordered_map<size_t, std::vector<void*>> freeSlots;
+};
+
+template <typename T>
+void LevelArenaDeleter::operator()(T* object) const
+{
+	object->~T();
+	arena->recycle(object, size);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Shared by Level::parse and the level generator in tools/
+constexpr const char* level_palette_filename = "assets/level_palette.txt";
+
+enum class PaletteKind : uint8_t
+{
+	Tile, Enemy, Start, Button, Decor, Diagonal
+};
+
+constexpr const char* palette_kind_names[] = {"tile", "enemy", "start", "button", "decor", "diagonal"};
+
+struct PaletteEntry
+{
+	// An ABGR8888 pixel, as Level::parse reads the image: A, B, G, R from the high byte
+	uint32_t color = 0;
+	PaletteKind kind = PaletteKind::Tile;
+	// What of its kind it spawns, the image file for decors
+	std::string name;
+	// Drawn size of decors
+	int width = 0;
+	int height = 0;
+};
+
+/// The level image colours from level_palette.txt, sorted by colour so find() is a binary search
+class LevelPalette
+{
+public:
+	/// Replaces the entries with the ones in the file. On a malformed line it stops and describes it in error.
+	bool load(const std::string& filename, std::string& error)
+	{
+		entries.clear();
+		std::ifstream file(filename);
+		if (!file)
+		{
+			error = "Could not open " + filename;
+			return false;
+		}
+
+		std::string line;
+		for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+		{
+			std::istringstream words(line);
+			std::string color;
+			std::string kind;
+			if (!(words >> color) || color[0] == '#')
+			{
+				continue;
+			}
+
+			PaletteEntry entry;
+			char* end = nullptr;
+			entry.color = (uint32_t)strtoul(color.c_str(), &end, 16);
+			if (*end != '\0' || !(words >> kind >> entry.name) || !parseKind(kind, entry.kind) ||
+			    (entry.kind == PaletteKind::Decor && !(words >> entry.width >> entry.height)))
+			{
+				error = filename + ":" + std::to_string(lineNumber) + ": can not read \"" + line + "\"";
+				return false;
+			}
+			entries.push_back(entry);
+		}
+
+		std::sort(entries.begin(), entries.end(), [](const PaletteEntry& a, const PaletteEntry& b) { return a.color < b.color; });
+		for (size_t i = 1; i < entries.size(); i++)
+		{
+			if (entries[i].color == entries[i - 1].color)
+			{
+				char color[16];
+				snprintf(color, sizeof(color), "%08x", entries[i].color);
+				error = filename + ": colour " + color + " is listed twice";
+				entries.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// Index of the colour's entry, -1 for colours that are not in the palette
+	int find(uint32_t color) const
+	{
+		const auto it = std::lower_bound(entries.begin(), entries.end(), color,
+		                                 [](const PaletteEntry& entry, uint32_t color) { return entry.color < color; });
+		return it != entries.end() && it->color == color ? (int)(it - entries.begin()) : -1;
+	}
+
+	/// The entry spawning the named thing, null when the palette has none
+	const PaletteEntry* find(PaletteKind kind, const std::string& name) const
+	{
+		for (const PaletteEntry& entry : entries)
+		{
+			if (entry.kind == kind && entry.name == name)
+			{
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	const std::vector<PaletteEntry>& getEntries() const
+	{
+		return entries;
+	}
+
+private:
+	static bool parseKind(const std::string& name, PaletteKind& kind)
+	{
+		for (size_t i = 0; i < sizeof(palette_kind_names) / sizeof(palette_kind_names[0]); i++)
+		{
+			if (name == palette_kind_names[i])
+			{
+				kind = (PaletteKind)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<PaletteEntry> entries;
+};
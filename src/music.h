@@ -0,0 +1,272 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <SDL.h>
+#include <SDL_mixer.h>
+#include "definitions.h"
+
+// Default fade used when switching between two tracks
+constexpr int32 music_crossfade_ms = 750;
+
+enum class MusicTrack
+{
+	None = -1, Title, Level, Boss, WinScreen, Count
+};
+
+struct MusicTrackSlot
+{
+	const char* filename = nullptr;
+	std::vector<uint8> fileData;
+	Mix_Music* music = nullptr;
+	real64 decodeMs = 0;
+	bool loaded = false;
+};
+
+/// Owns all Mix_*Music calls. On desktop they run on a worker thread, so loading a track,
+/// waiting for a fade out and starting the next stream never block the game thread.
+/// Without threads (web build) the same state machine is stepped from the main loop.
+class MusicPlayer
+{
+public:
+	void init()
+	{
+		slots[(int32)MusicTrack::Title].filename = "assets/menu.ogg";
+		slots[(int32)MusicTrack::Level].filename = "assets/level.ogg";
+		slots[(int32)MusicTrack::Boss].filename = "assets/boss.ogg";
+		slots[(int32)MusicTrack::WinScreen].filename = "assets/win_screen.ogg";
+
+		mutex = SDL_CreateMutex();
+		wake = SDL_CreateCond();
+		running = true;
+#ifndef __EMSCRIPTEN__
+		worker = SDL_CreateThread(workerMain, "music", this);
+		if (!worker)
+		{
+			LogWarn("Could not start music thread, falling back to main loop: %s", SDL_GetError());
+		}
+#endif
+	}
+
+	void shutdown()
+	{
+		SDL_LockMutex(mutex);
+		running = false;
+		SDL_CondSignal(wake);
+		SDL_UnlockMutex(mutex);
+		if (worker)
+		{
+			SDL_WaitThread(worker, NULL);
+			worker = nullptr;
+		}
+	}
+
+	/// Hint that the track is likely to be played soon, so it gets read and decoded in the background
+	void preload(MusicTrack track)
+	{
+		SDL_LockMutex(mutex);
+		preloadQueue.push_back(track);
+		SDL_CondSignal(wake);
+		SDL_UnlockMutex(mutex);
+	}
+
+	/// Fades the current track out and the new one in. A fade of 0 switches immediately.
+	void play(MusicTrack track, int32 fadeMs = music_crossfade_ms)
+	{
+		SDL_LockMutex(mutex);
+		hasRequest = true;
+		requestedTrack = track;
+		requestedFadeMs = fadeMs;
+		SDL_CondSignal(wake);
+		SDL_UnlockMutex(mutex);
+	}
+
+	void stop(int32 fadeMs = 0)
+	{
+		play(MusicTrack::None, fadeMs);
+	}
+
+	inline void setVolume(int32 volume)
+	{
+		Mix_VolumeMusic(volume);
+	}
+
+	/// Steps the player from the main loop when there is no worker thread
+	void update()
+	{
+		if (!worker)
+		{
+			pump();
+		}
+	}
+
+	real64 getDecodeMs(MusicTrack track)
+	{
+		SDL_LockMutex(mutex);
+		const real64 result = slots[(int32)track].decodeMs;
+		SDL_UnlockMutex(mutex);
+		return result;
+	}
+
+private:
+	static int workerMain(void* data)
+	{
+		MusicPlayer* player = (MusicPlayer*)data;
+		while (true)
+		{
+			const bool busy = player->pump();
+
+			SDL_LockMutex(player->mutex);
+			if (!player->running)
+			{
+				SDL_UnlockMutex(player->mutex);
+				break;
+			}
+			if (player->fadingOut)
+			{
+				// Poll until the mixer is done fading out
+				SDL_CondWaitTimeout(player->wake, player->mutex, 10);
+			}
+			else if (!busy && player->preloadQueue.empty() && !player->hasRequest)
+			{
+				SDL_CondWait(player->wake, player->mutex);
+			}
+			SDL_UnlockMutex(player->mutex);
+		}
+		return 0;
+	}
+
+	/// Does one step of pending work, returns true if anything was done
+	bool pump()
+	{
+		SDL_LockMutex(mutex);
+		MusicTrack toLoad = MusicTrack::None;
+		if (!preloadQueue.empty())
+		{
+			toLoad = preloadQueue.front();
+			preloadQueue.pop_front();
+		}
+		const bool request = hasRequest;
+		const MusicTrack track = requestedTrack;
+		const int32 fadeMs = requestedFadeMs;
+		SDL_UnlockMutex(mutex);
+
+		if (toLoad != MusicTrack::None)
+		{
+			loadTrack(toLoad);
+			return true;
+		}
+		if (!request)
+		{
+			return false;
+		}
+
+		if (!fadingOut && currentTrack != MusicTrack::None && Mix_PlayingMusic())
+		{
+			if (track == currentTrack)
+			{
+				finishRequest(track);
+				return true;
+			}
+			if (fadeMs > 0)
+			{
+				Mix_FadeOutMusic(fadeMs);
+				fadingOut = true;
+				return true;
+			}
+			Mix_HaltMusic();
+		}
+		if (fadingOut && Mix_PlayingMusic())
+		{
+			return false;
+		}
+		fadingOut = false;
+
+		if (track != MusicTrack::None)
+		{
+			MusicTrackSlot& slot = slots[(int32)track];
+			if (!slot.loaded)
+			{
+				loadTrack(track);
+			}
+			if (slot.music)
+			{
+				if (fadeMs > 0)
+				{
+					Mix_FadeInMusic(slot.music, -1, fadeMs);
+				}
+				else
+				{
+					Mix_PlayMusic(slot.music, -1);
+				}
+			}
+		}
+		finishRequest(track);
+		return true;
+	}
+
+	void finishRequest(MusicTrack track)
+	{
+		currentTrack = track;
+		SDL_LockMutex(mutex);
+		// A newer request may have come in while this one was being handled
+		if (requestedTrack == track)
+		{
+			hasRequest = false;
+		}
+		SDL_UnlockMutex(mutex);
+	}
+
+	/// Reads the whole file into memory and opens the decoder on it, so starting the stream later does no disk I/O
+	void loadTrack(MusicTrack track)
+	{
+		MusicTrackSlot& slot = slots[(int32)track];
+		if (slot.loaded)
+		{
+			return;
+		}
+
+		const uint64 start = SDL_GetPerformanceCounter();
+		SDL_RWops* file = SDL_RWFromFile(slot.filename, "rb");
+		if (file)
+		{
+			const Sint64 size = SDL_RWsize(file);
+			if (size > 0)
+			{
+				slot.fileData.resize(size);
+				SDL_RWread(file, slot.fileData.data(), 1, size);
+			}
+			SDL_RWclose(file);
+		}
+		if (!slot.fileData.empty())
+		{
+			slot.music = Mix_LoadMUS_RW(SDL_RWFromConstMem(slot.fileData.data(), (int)slot.fileData.size()), 1);
+		}
+		if (!slot.music)
+		{
+			LogError("Failed to load music %s! SDL_mixer Error: %s\n", slot.filename, Mix_GetError());
+		}
+		const real64 decodeMs = 1000.0 * (real64)(SDL_GetPerformanceCounter() - start) / (real64)SDL_GetPerformanceFrequency();
+		LogInfo("Music %s decoded in %.2f ms", slot.filename, decodeMs);
+
+		SDL_LockMutex(mutex);
+		slot.decodeMs = decodeMs;
+		slot.loaded = true;
+		SDL_UnlockMutex(mutex);
+	}
+
+	std::array<MusicTrackSlot, (size_t)MusicTrack::Count> slots;
+	std::deque<MusicTrack> preloadQueue;
+	SDL_Thread* worker = nullptr;
+	SDL_mutex* mutex = nullptr;
+	SDL_cond* wake = nullptr;
+	bool running = false;
+	bool hasRequest = false;
+	MusicTrack requestedTrack = MusicTrack::None;
+	int32 requestedFadeMs = 0;
+	// Only touched by the thread that runs pump()
+	MusicTrack currentTrack = MusicTrack::None;
+	bool fadingOut = false;
+};
+
+MusicPlayer music_player;
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <SDL.h>
+#include "definitions.h"
+
+// Particles per texture, the storage never grows
+constexpr uint32 particle_pool_capacity = 16384;
+// Ambient bubbles started per second around the camera
+constexpr real32 ambient_bubble_rate = 10;
+
+enum class ParticleTexture : uint8
+{
+	Bubble1, Bubble2, Bubble3, Debris, Count
+};
+
+struct ParticleEmit
+{
+	Vector2f position;
+	Vector2f velocity;
+	real32 size = 0;
+	real32 lifetime = 1;
+	// Horizontal sway in pixels, for bubbles
+	real32 wobble = 0;
+	// Normalized square of the texture to draw
+	real32 texU = 0;
+	real32 texV = 0;
+	real32 texSize = 1;
+};
+
+/// Particles that share a texture and how they move. Structure of arrays with a fixed capacity,
+/// the live particles are packed at the front so the update is one pass over plain floats.
+struct ParticlePool
+{
+	void integrate(real32 time_delta)
+	{
+		const real32 damping = powf(drag, time_delta);
+		const real32 fall = gravity * time_delta;
+		real32* __restrict px = posX.data();
+		real32* __restrict py = posY.data();
+		real32* __restrict vx = velX.data();
+		real32* __restrict vy = velY.data();
+		real32* __restrict ages = age.data();
+		const real32* __restrict ageRates = ageRate.data();
+		for (uint32 i = 0; i < count; ++i)
+		{
+			vx[i] *= damping;
+			vy[i] = vy[i] * damping + fall;
+			px[i] += vx[i] * time_delta;
+			py[i] += vy[i] * time_delta;
+			ages[i] += ageRates[i] * time_delta;
+		}
+
+		// Move the last live particle into each expired slot
+		uint32 i = 0;
+		while (i < count)
+		{
+			if (age[i] >= 1)
+			{
+				--count;
+				copy(count, i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
+	void copy(uint32 from, uint32 to)
+	{
+		posX[to] = posX[from];
+		posY[to] = posY[from];
+		velX[to] = velX[from];
+		velY[to] = velY[from];
+		age[to] = age[from];
+		ageRate[to] = ageRate[from];
+		size[to] = size[from];
+		wobble[to] = wobble[from];
+		phase[to] = phase[from];
+		texU[to] = texU[from];
+		texV[to] = texV[from];
+		texSize[to] = texSize[from];
+	}
+
+	SDL_Texture* texture = nullptr;
+	// Added to the vertical velocity every second, negative makes particles rise
+	real32 gravity = 0;
+	// Part of the velocity that is left after one second
+	real32 drag = 1;
+	// How fast particles fade at the end of their life, 1 fades over the whole life
+	real32 fadeSpeed = 1;
+	uint32 count = 0;
+
+	std::array<real32, particle_pool_capacity> posX;
+	std::array<real32, particle_pool_capacity> posY;
+	std::array<real32, particle_pool_capacity> velX;
+	std::array<real32, particle_pool_capacity> velY;
+	// 0 when spawned, 1 when expired
+	std::array<real32, particle_pool_capacity> age;
+	std::array<real32, particle_pool_capacity> ageRate;
+	std::array<real32, particle_pool_capacity> size;
+	std::array<real32, particle_pool_capacity> wobble;
+	std::array<real32, particle_pool_capacity> phase;
+	std::array<real32, particle_pool_capacity> texU;
+	std::array<real32, particle_pool_capacity> texV;
+	std::array<real32, particle_pool_capacity> texSize;
+};
+
+/// Block debris, bubble pops and the ambient bubbles. Every texture is drawn with one SDL_RenderGeometry call.
+class ParticleSystem
+{
+public:
+	void init(SDL_Texture* bubble1, SDL_Texture* bubble2, SDL_Texture* bubble3, SDL_Texture* debris)
+	{
+		SDL_Texture* bubbles[] = {bubble1, bubble2, bubble3};
+		for (int32 i = 0; i < 3; ++i)
+		{
+			ParticlePool& pool = pools[i];
+			pool.texture = bubbles[i];
+			pool.gravity = -900;
+			pool.drag = 0.3f;
+			pool.fadeSpeed = 5;
+		}
+		ParticlePool& debrisPool = pools[(int32)ParticleTexture::Debris];
+		debrisPool.texture = debris;
+		debrisPool.gravity = 1800;
+		debrisPool.drag = 0.2f;
+		debrisPool.fadeSpeed = 2;
+
+		indices.resize(particle_pool_capacity * 6);
+		for (uint32 i = 0; i < particle_pool_capacity; ++i)
+		{
+			const int32 first = i * 4;
+			const int32 quad[] = {first, first + 1, first + 2, first, first + 2, first + 3};
+			std::copy(quad, quad + 6, indices.begin() + i * 6);
+		}
+	}
+
+	void clear()
+	{
+		for (ParticlePool& pool : pools)
+		{
+			pool.count = 0;
+		}
+		ambientDebt = 0;
+	}
+
+	/// Returns false when the pool is full and the particle was dropped
+	bool emit(ParticleTexture texture, const ParticleEmit& particle)
+	{
+		ParticlePool& pool = pools[(int32)texture];
+		if (pool.count == particle_pool_capacity)
+		{
+			return false;
+		}
+		const uint32 i = pool.count++;
+		pool.posX[i] = particle.position.x;
+		pool.posY[i] = particle.position.y;
+		pool.velX[i] = particle.velocity.x;
+		pool.velY[i] = particle.velocity.y;
+		pool.age[i] = 0;
+		pool.ageRate[i] = 1 / particle.lifetime;
+		pool.size[i] = particle.size;
+		pool.wobble[i] = particle.wobble;
+		pool.phase[i] = randomRange(0, 2 * Pi32);
+		pool.texU[i] = particle.texU;
+		pool.texV[i] = particle.texV;
+		pool.texSize[i] = particle.texSize;
+		return true;
+	}
+
+	/// Small chunks of the block texture thrown along the breaking velocity
+	void emitBlockDebris(const Rect2f& block, Vector2f velocity)
+	{
+		const int32 chunks = 4;
+		const real32 chunkSize = block.w / chunks;
+		const Vector2f carried = velocity * 0.3f;
+		for (int32 y = 0; y < chunks; ++y)
+		{
+			for (int32 x = 0; x < chunks; ++x)
+			{
+				ParticleEmit particle;
+				particle.position = {block.x + (x + 0.5f) * chunkSize, block.y + (y + 0.5f) * chunkSize};
+				const Vector2f outward = (particle.position - block.getCenter()) * 12.f;
+				particle.velocity = carried + outward + Vector2f(randomRange(-300, 300), randomRange(-700, 100));
+				particle.size = chunkSize;
+				particle.lifetime = randomRange(0.6f, 1.1f);
+				particle.texU = (real32)x / chunks;
+				particle.texV = (real32)y / chunks;
+				particle.texSize = 1.f / chunks;
+				emit(ParticleTexture::Debris, particle);
+			}
+		}
+	}
+
+	/// A ring of small bubbles where a bubble popped
+	void emitBubblePop(Vector2f center, real32 radius)
+	{
+		const int32 bubbles = 14;
+		for (int32 i = 0; i < bubbles; ++i)
+		{
+			const real32 angle = (i + randomRange(0, 0.8f)) * 2 * Pi32 / bubbles;
+			const Vector2f direction = {cosf(angle), sinf(angle)};
+			ParticleEmit particle;
+			particle.position = center + direction * radius * randomRange(0.6f, 1.f);
+			particle.velocity = direction * randomRange(300, 900);
+			particle.size = randomRange(20, 50);
+			particle.lifetime = randomRange(0.4f, 0.9f);
+			particle.wobble = 6;
+			emit(randomBubbleTexture(), particle);
+		}
+	}
+
+	/// Starts bubbles below the camera so they rise through the view, never inside tiles
+	void spawnAmbientBubbles(const Level& level, const Rect2f& camera, real32 time_delta)
+	{
+		ambientDebt += ambient_bubble_rate * time_delta;
+		while (ambientDebt >= 1)
+		{
+			ambientDebt -= 1;
+			// At the bottom of the level they come out of the floor instead
+			const Vector2f position = {randomRange(camera.x, camera.x + camera.w),
+			                           MIN(camera.y + camera.h + randomRange(0, 200), (real32)level.height - 1)};
+			if (level.isCellBlocked((int32)(position.x / LEVEL_SCALE), (int32)(position.y / LEVEL_SCALE)))
+			{
+				continue;
+			}
+			ParticleEmit particle;
+			particle.position = position;
+			particle.velocity = {randomRange(-40, 40), randomRange(-500, -200)};
+			particle.size = randomRange(25, 70);
+			particle.lifetime = randomRange(2.5f, 4.f);
+			particle.wobble = particle.size * 0.4f;
+			emit(randomBubbleTexture(), particle);
+		}
+	}
+
+	void update(real32 time_delta)
+	{
+		for (ParticlePool& pool : pools)
+		{
+			pool.integrate(time_delta);
+		}
+	}
+
+	/// Draws with the same camera offset as renderTexture, skipping what is outside the view
+	void render(SDL_Renderer* renderer, const Rect2f& camera, Vector2f screenShake)
+	{
+		const Vector2f offset = screenShake - Vector2f(camera.x, camera.y);
+		for (ParticlePool& pool : pools)
+		{
+			if (!pool.texture || pool.count == 0)
+			{
+				continue;
+			}
+			// Only lives until the draw call
+			FrameVector<SDL_Vertex> vertices(pool.count * 4, FrameAllocator<SDL_Vertex>("particle vertices"));
+			uint32 quads = 0;
+			for (uint32 i = 0; i < pool.count; ++i)
+			{
+				const real32 half = pool.size[i] / 2;
+				const real32 sway = pool.wobble[i] * sinf(pool.phase[i] + pool.age[i] * 12);
+				const real32 x = pool.posX[i] + sway + offset.x;
+				const real32 y = pool.posY[i] + offset.y;
+				if (x + half < 0 || y + half < 0 || x - half > camera.w || y - half > camera.h)
+				{
+					continue;
+				}
+
+				const real32 alpha = MIN(1.f, (1 - pool.age[i]) * pool.fadeSpeed);
+				const SDL_Color color = {255, 255, 255, (uint8)(alpha * 255)};
+				const real32 u0 = pool.texU[i];
+				const real32 v0 = pool.texV[i];
+				const real32 u1 = u0 + pool.texSize[i];
+				const real32 v1 = v0 + pool.texSize[i];
+				SDL_Vertex* quad = &vertices[quads * 4];
+				quad[0] = {{x - half, y - half}, color, {u0, v0}};
+				quad[1] = {{x + half, y - half}, color, {u1, v0}};
+				quad[2] = {{x + half, y + half}, color, {u1, v1}};
+				quad[3] = {{x - half, y + half}, color, {u0, v1}};
+				quads++;
+			}
+			if (quads > 0)
+			{
+				SDL_RenderGeometry(renderer, pool.texture, vertices.data(), quads * 4, indices.data(), quads * 6);
+			}
+		}
+	}
+
+	uint32 getCount() const
+	{
+		uint32 total = 0;
+		for (const ParticlePool& pool : pools)
+		{
+			total += pool.count;
+		}
+		return total;
+	}
+
+private:
+	static real32 randomRange(real32 low, real32 high)
+	{
+		return std::uniform_real_distribution<real32>(low, high)(rng);
+	}
+
+	static ParticleTexture randomBubbleTexture()
+	{
+		return (ParticleTexture)std::uniform_int_distribution<int32>(0, 2)(rng);
+	}
+
+	std::array<ParticlePool, (size_t)ParticleTexture::Count> pools;
+	// Quad indices, the same for every texture
+	std::vector<int32> indices;
+	// Fraction of an ambient bubble carried over to the next frame
+	real32 ambientDebt = 0;
+};
+
+ParticleSystem particle_system;
+
+void emitBlockDebris(const Rect2f& block, Vector2f velocity)
+{
+	particle_system.emitBlockDebris(block, velocity);
+}
+
+void emitBubblePop(Vector2f center, real32 radius)
+{
+	particle_system.emitBubblePop(center, radius);
+}
+
+void clearParticles()
+{
+	particle_system.clear();
+}
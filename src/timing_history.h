@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include "definitions.h"
+
+// Samples kept for the percentile stats
+constexpr uint32 timing_history_size = 256;
+
+struct TimingSummary
+{
+	real32 meanMs = 0;
+	real32 p50Ms = 0;
+	real32 p95Ms = 0;
+	real32 p99Ms = 0;
+	real32 maxMs = 0;
+	uint32 sampleCount = 0;
+};
+
+/// The last timing_history_size samples in milliseconds
+class TimingHistory
+{
+public:
+	void add(real32 ms)
+	{
+		samples[cursor] = ms;
+		cursor = (cursor + 1) % timing_history_size;
+		count = MIN(count + 1, timing_history_size);
+	}
+
+	inline void clear()
+	{
+		count = cursor = 0;
+	}
+
+	inline uint32 getCount() const
+	{
+		return count;
+	}
+
+	/// 0 is the oldest sample
+	inline real32 get(uint32 i) const
+	{
+		const uint32 oldest = count < timing_history_size ? 0 : cursor;
+		return samples[(oldest + i) % timing_history_size];
+	}
+
+	TimingSummary summarize() const
+	{
+		TimingSummary summary;
+		summary.sampleCount = count;
+		if (count == 0)
+		{
+			return summary;
+		}
+
+		std::array<real32, timing_history_size> sorted;
+		real32 sum = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			sorted[i] = samples[i];
+			sum += samples[i];
+		}
+		std::sort(sorted.begin(), sorted.begin() + count);
+
+		const auto percentile = [&](real32 p) { return sorted[MIN((uint32)(p * count), count - 1)]; };
+		summary.meanMs = sum / count;
+		summary.p50Ms = percentile(0.50f);
+		summary.p95Ms = percentile(0.95f);
+		summary.p99Ms = percentile(0.99f);
+		summary.maxMs = sorted[count - 1];
+		return summary;
+	}
+
+private:
+	std::array<real32, timing_history_size> samples = {};
+	uint32 cursor = 0;
+	uint32 count = 0;
+};
@@ -0,0 +1,117 @@
+// Offline glyph atlas baker for SDL_FontCache.
+// Rasterizes the loading string of a TTF at the given point sizes and writes, per size,
+// <out_dir>/<font name>_<size>.fnt with the metrics and <out_dir>/<font name>_<size>_<level>.png per cache level.
+// The game picks these up through loadFont() in src/fonts.h.
+//
+// Usage: font_baker <font.ttf> <out_dir> <point size>...   (out_dir is created if it is missing)
+// e.g.   font_baker assets/Action_Man.ttf assets/fonts 120 144 288 432
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+#include "SDL_FontCache.h"
+
+// Same limit as FC_LOAD_MAX_SURFACES
+constexpr int max_levels = 10;
+
+static bool bakeFont(const char* ttfFilename, const std::string& prefix, int pointSize)
+{
+	TTF_Font* ttf = TTF_OpenFont(ttfFilename, pointSize);
+	if (!ttf)
+	{
+		fprintf(stderr, "Could not open %s: %s\n", ttfFilename, TTF_GetError());
+		return false;
+	}
+
+	FC_Font* font = FC_CreateFont();
+	SDL_Surface* levels[max_levels];
+	const int levelCount = FC_BakeFontSurfaces(font, ttf, levels, max_levels);
+	bool ok = levelCount > 0;
+
+	for (int i = 0; i < levelCount; i++)
+	{
+		const std::string filename = prefix + "_" + std::to_string(i) + ".png";
+		if (IMG_SavePNG(levels[i], filename.c_str()) != 0)
+		{
+			fprintf(stderr, "Could not write %s: %s\n", filename.c_str(), IMG_GetError());
+			ok = false;
+		}
+		SDL_FreeSurface(levels[i]);
+	}
+
+	char* metrics = FC_GetBakedMetrics(font);
+	const std::string filename = prefix + ".fnt";
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file && metrics)
+	{
+		fputs(metrics, file);
+		fclose(file);
+		printf("Baked %s (%d cache levels)\n", filename.c_str(), levelCount);
+	}
+	else
+	{
+		fprintf(stderr, "Could not write %s\n", filename.c_str());
+		ok = false;
+	}
+
+	free(metrics);
+	FC_FreeFont(font);
+	TTF_CloseFont(ttf);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s <font.ttf> <out_dir> <point size>...\n", argv[0]);
+		return 1;
+	}
+
+	if (SDL_Init(0) < 0 || TTF_Init() < 0)
+	{
+		fprintf(stderr, "Could not initialize SDL_ttf: %s\n", TTF_GetError());
+		return 1;
+	}
+	IMG_Init(IMG_INIT_PNG);
+
+	std::error_code error;
+	std::filesystem::create_directories(argv[2], error);
+	if (error)
+	{
+		fprintf(stderr, "Could not create %s: %s\n", argv[2], error.message().c_str());
+		return 1;
+	}
+
+	const char* ttfFilename = argv[1];
+	std::string name = ttfFilename;
+	const size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+	{
+		name = name.substr(slash + 1);
+	}
+	const size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos)
+	{
+		name = name.substr(0, dot);
+	}
+
+	int result = 0;
+	for (int i = 3; i < argc; i++)
+	{
+		const int pointSize = atoi(argv[i]);
+		if (pointSize <= 0 || !bakeFont(ttfFilename, std::string(argv[2]) + "/" + name + "_" + std::to_string(pointSize), pointSize))
+		{
+			result = 1;
+		}
+	}
+
+	IMG_Quit();
+	TTF_Quit();
+	SDL_Quit();
+	return result;
+}
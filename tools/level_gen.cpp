@@ -0,0 +1,385 @@
+// Stress level generator. Writes level images with the colours of assets/level_palette.txt, so Level::load reads
+// them like the hand made levels. Run it from the repo root. With --sweep it writes a series of growing levels and a list of them for the game's
+// --bench mode, which prints load, collision, update and draw times per level.
+//
+// Usage: level_gen [options] <out.png>
+//        level_gen --sweep <out_dir>
+// Options, defaults in brackets:
+//   --width=N [256] --height=N [36]   size in cells
+//   --density=F [0.2]                 part of the inner cells that are tiles
+//   --breakable=F [0.1]               part of the tiles that are breakable
+//   --fish=N [10] --jellyfish=N [4] --shrimp=N [4] --shrimp-inverted=N [2]
+//   --decors=N [20] --diagonals=N [2] --buttons=N [2] --moving=N [0]
+//   --seed=N [1]
+//   --palette=<file> [assets/level_palette.txt]
+// e.g.   level_gen --sweep assets/stress
+//        Game2024 --bench=assets/stress/sweep.txt
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_image.h>
+#include "level_palette.h"
+
+// Same as diagonal_cells in definitions.h
+constexpr int diagonal_block = 8;
+
+// Not in the palette, so empty water
+constexpr uint32_t empty_color = 0xffffffff;
+
+/// The colours the generator paints with, from the level palette
+struct LevelColors
+{
+	uint32_t tileTop = 0;
+	uint32_t tileMid = 0;
+	uint32_t tileBreakable = 0;
+	uint32_t tileMoving = 0;
+	uint32_t player = 0;
+	uint32_t key = 0;
+	uint32_t door = 0;
+	uint32_t fish = 0;
+	uint32_t jellyfish = 0;
+	uint32_t shrimp = 0;
+	uint32_t shrimpInverted = 0;
+	uint32_t button = 0;
+	uint32_t buttonInverted = 0;
+	// In the order of the corners: top left, top right, bottom left, bottom right
+	uint32_t diagonals[4] = {};
+	std::vector<uint32_t> decors;
+
+	bool load(const LevelPalette& palette, std::string& error)
+	{
+		const std::pair<uint32_t*, std::pair<PaletteKind, const char*>> wanted[] = {
+			{&tileTop, {PaletteKind::Tile, "top"}}, {&tileMid, {PaletteKind::Tile, "mid"}},
+			{&tileBreakable, {PaletteKind::Tile, "breakable"}}, {&tileMoving, {PaletteKind::Tile, "moving"}},
+			{&player, {PaletteKind::Start, "player"}}, {&key, {PaletteKind::Start, "key"}}, {&door, {PaletteKind::Start, "door"}},
+			{&fish, {PaletteKind::Enemy, "fish"}}, {&jellyfish, {PaletteKind::Enemy, "jellyfish"}},
+			{&shrimp, {PaletteKind::Enemy, "shrimp"}}, {&shrimpInverted, {PaletteKind::Enemy, "shrimp_inverted"}},
+			{&button, {PaletteKind::Button, "normal"}}, {&buttonInverted, {PaletteKind::Button, "inverted"}},
+			{&diagonals[0], {PaletteKind::Diagonal, "top_left"}}, {&diagonals[1], {PaletteKind::Diagonal, "top_right"}},
+			{&diagonals[2], {PaletteKind::Diagonal, "bot_left"}}, {&diagonals[3], {PaletteKind::Diagonal, "bot_right"}},
+		};
+		for (const auto& color : wanted)
+		{
+			const PaletteEntry* entry = palette.find(color.second.first, color.second.second);
+			if (!entry)
+			{
+				error = std::string("The palette has no ") + palette_kind_names[(size_t)color.second.first] + " " + color.second.second;
+				return false;
+			}
+			*color.first = entry->color;
+		}
+		for (const PaletteEntry& entry : palette.getEntries())
+		{
+			if (entry.kind == PaletteKind::Decor)
+			{
+				decors.push_back(entry.color);
+			}
+		}
+		if (palette.find(empty_color) >= 0)
+		{
+			error = "The palette uses white, which the generator leaves empty";
+			return false;
+		}
+		return true;
+	}
+};
+
+struct LevelParams
+{
+	int width = 256;
+	int height = 36;
+	float density = 0.2f;
+	float breakable = 0.1f;
+	int fish = 10;
+	int jellyfish = 4;
+	int shrimp = 4;
+	int shrimpInverted = 2;
+	int decors = 20;
+	int diagonals = 2;
+	int buttons = 2;
+	int moving = 0;
+	unsigned seed = 1;
+	std::string paletteFilename = level_palette_filename;
+};
+
+class LevelImage
+{
+public:
+	LevelImage(const LevelParams& params, const LevelColors& colors)
+		: params(params), colors(colors), rng(params.seed), pixels(params.width * params.height, empty_color)
+	{
+	}
+
+	void generate()
+	{
+		// Walls all around, so nothing leaves the level
+		for (int x = 0; x < params.width; x++)
+		{
+			set(x, 0, colors.tileMid);
+			set(x, params.height - 1, colors.tileMid);
+		}
+		for (int y = 0; y < params.height; y++)
+		{
+			set(0, y, colors.tileMid);
+			set(params.width - 1, y, colors.tileMid);
+		}
+
+		std::uniform_real_distribution<float> unit(0, 1);
+		for (int y = 1; y < params.height - 1; y++)
+		{
+			for (int x = 1; x < params.width - 1; x++)
+			{
+				if (unit(rng) < params.density)
+				{
+					set(x, y, unit(rng) < params.breakable ? colors.tileBreakable : colors.tileTop);
+				}
+			}
+		}
+
+		// Diagonals clear their whole block, the marker goes in the corner the direction names
+		for (int i = 0; i < params.diagonals; i++)
+		{
+			if (params.width < diagonal_block + 2 || params.height < diagonal_block + 2)
+			{
+				break;
+			}
+			const int left = randomInt(1, params.width - 1 - diagonal_block);
+			const int top = randomInt(1, params.height - 1 - diagonal_block);
+			clear(left, top, diagonal_block, diagonal_block);
+			const int direction = randomInt(0, 4);
+			const int x = (direction == 1 || direction == 3) ? left + diagonal_block - 1 : left;
+			const int y = (direction >= 2) ? top + diagonal_block - 1 : top;
+			set(x, y, colors.diagonals[direction]);
+		}
+
+		// The player starts on the left with the key next to it, the door is on the far right
+		place(colors.player, 2, params.height / 2);
+		place(colors.key, 6, params.height / 2);
+		place(colors.door, params.width - 4, params.height / 2);
+
+		placeRandom(colors.fish, params.fish);
+		placeRandom(colors.jellyfish, params.jellyfish);
+		placeRandom(colors.shrimp, params.shrimp);
+		placeRandom(colors.shrimpInverted, params.shrimpInverted);
+		placeRandom(colors.tileMoving, params.moving);
+
+		for (int i = 0; i < params.buttons; i++)
+		{
+			placeRandom(i % 2 ? colors.buttonInverted : colors.button, 1);
+		}
+
+		for (int i = 0; i < params.decors && !colors.decors.empty(); i++)
+		{
+			placeRandom(colors.decors[randomInt(0, (int)colors.decors.size())], 1);
+		}
+	}
+
+	bool save(const char* filename) const
+	{
+		SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, params.width, params.height, 32, SDL_PIXELFORMAT_ABGR8888);
+		if (!surface)
+		{
+			fprintf(stderr, "Could not create surface: %s\n", SDL_GetError());
+			return false;
+		}
+		// ABGR8888 is how an RGBA png comes back from IMG_Load, which is what the palette is written in
+		for (int y = 0; y < params.height; y++)
+		{
+			memcpy((uint8_t*)surface->pixels + y * surface->pitch, &pixels[y * params.width], params.width * sizeof(uint32_t));
+		}
+		const bool ok = IMG_SavePNG(surface, filename) == 0;
+		if (!ok)
+		{
+			fprintf(stderr, "Could not write %s: %s\n", filename, IMG_GetError());
+		}
+		SDL_FreeSurface(surface);
+		return ok;
+	}
+
+private:
+	int randomInt(int low, int high)
+	{
+		return std::uniform_int_distribution<int>(low, high - 1)(rng);
+	}
+
+	void set(int x, int y, uint32_t color)
+	{
+		pixels[y * params.width + x] = color;
+	}
+
+	void clear(int left, int top, int width, int height)
+	{
+		for (int y = top; y < top + height; y++)
+		{
+			for (int x = left; x < left + width; x++)
+			{
+				set(x, y, empty_color);
+			}
+		}
+	}
+
+	/// Spawn points get some room around them, the sprites are bigger than a cell
+	void place(uint32_t color, int x, int y)
+	{
+		x = std::max(2, std::min(x, params.width - 3));
+		y = std::max(2, std::min(y, params.height - 3));
+		clear(x - 1, y - 1, 3, 3);
+		set(x, y, color);
+	}
+
+	void placeRandom(uint32_t color, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			place(color, randomInt(2, params.width - 2), randomInt(2, params.height - 2));
+		}
+	}
+
+	LevelParams params;
+	LevelColors colors;
+	std::mt19937 rng;
+	std::vector<uint32_t> pixels;
+};
+
+static bool parseOption(const char* arg, LevelParams& params)
+{
+	const char* value = strchr(arg, '=');
+	if (!value)
+	{
+		return false;
+	}
+	const std::string name(arg, value - arg);
+	value++;
+	if (name == "--width") params.width = atoi(value);
+	else if (name == "--height") params.height = atoi(value);
+	else if (name == "--density") params.density = (float)atof(value);
+	else if (name == "--breakable") params.breakable = (float)atof(value);
+	else if (name == "--fish") params.fish = atoi(value);
+	else if (name == "--jellyfish") params.jellyfish = atoi(value);
+	else if (name == "--shrimp") params.shrimp = atoi(value);
+	else if (name == "--shrimp-inverted") params.shrimpInverted = atoi(value);
+	else if (name == "--decors") params.decors = atoi(value);
+	else if (name == "--diagonals") params.diagonals = atoi(value);
+	else if (name == "--buttons") params.buttons = atoi(value);
+	else if (name == "--moving") params.moving = atoi(value);
+	else if (name == "--seed") params.seed = (unsigned)atoi(value);
+	else if (name == "--palette") params.paletteFilename = value;
+	else return false;
+	return true;
+}
+
+static bool loadColors(const std::string& paletteFilename, LevelColors& colors)
+{
+	LevelPalette palette;
+	std::string error;
+	if (!palette.load(paletteFilename, error) || !colors.load(palette, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+/// Levels from the size of level1 up to 64 times its area at two densities, spawners grow with the area
+static int writeSweep(const std::string& outDir, const LevelColors& colors)
+{
+	const std::string listFilename = outDir + "/sweep.txt";
+	FILE* list = fopen(listFilename.c_str(), "w");
+	if (!list)
+	{
+		fprintf(stderr, "Could not write %s\n", listFilename.c_str());
+		return 1;
+	}
+
+	const float densities[] = {0.1f, 0.25f};
+	int failed = 0;
+	for (int scale = 1; scale <= 8; scale *= 2)
+	{
+		for (const float density : densities)
+		{
+			LevelParams params;
+			params.width = 256 * scale;
+			params.height = 36 * scale;
+			params.density = density;
+			const int area = scale * scale;
+			params.fish *= area;
+			params.jellyfish *= area;
+			params.shrimp *= area;
+			params.shrimpInverted *= area;
+			params.decors *= area;
+			params.diagonals *= area;
+			params.buttons *= area;
+			params.moving = 4 * area;
+
+			char filename[64];
+			snprintf(filename, sizeof(filename), "stress_%dx%d_d%02d.png", params.width, params.height, (int)(density * 100));
+			LevelImage image(params, colors);
+			image.generate();
+			if (image.save((outDir + "/" + filename).c_str()))
+			{
+				fprintf(list, "%s/%s\n", outDir.c_str(), filename);
+				printf("Wrote %s/%s\n", outDir.c_str(), filename);
+			}
+			else
+			{
+				failed++;
+			}
+		}
+	}
+	fclose(list);
+	printf("Wrote %s\n", listFilename.c_str());
+	return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s [options] <out.png>\n       %s --sweep <out_dir>\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	if (IMG_Init(IMG_INIT_PNG) == 0)
+	{
+		fprintf(stderr, "IMG_Init failed: %s\n", IMG_GetError());
+		return 1;
+	}
+
+	int result = 0;
+	LevelColors colors;
+	if (strcmp(argv[1], "--sweep") == 0 && argc > 2)
+	{
+		result = loadColors(level_palette_filename, colors) ? writeSweep(argv[2], colors) : 1;
+	}
+	else
+	{
+		LevelParams params;
+		for (int i = 1; i < argc - 1; i++)
+		{
+			if (!parseOption(argv[i], params))
+			{
+				fprintf(stderr, "Unknown option %s\n", argv[i]);
+				return 1;
+			}
+		}
+		if (loadColors(params.paletteFilename, colors))
+		{
+			LevelImage image(params, colors);
+			image.generate();
+			result = image.save(argv[argc - 1]) ? 0 : 1;
+		}
+		else
+		{
+			result = 1;
+		}
+	}
+
+	IMG_Quit();
+	return result;
+}